@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ConsumerThreadPool.h"
+
+#include <EGL/egl.h>
+#include <glib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+std::atomic<uint32_t> s_threadCount = 0;
+std::atomic_bool s_started = false;
+thread_local const ConsumerThreadPool::Client* t_runningClient = nullptr;
+} // namespace
+
+ConsumerThreadPool& ConsumerThreadPool::getInstance() noexcept
+{
+    // Never destroyed, as views may still be destroyed while the process exits
+    static ConsumerThreadPool* s_pool = [] {
+        s_started = true;
+        uint32_t threadCount = s_threadCount;
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+        return new ConsumerThreadPool(threadCount);
+    }();
+
+    return *s_pool;
+}
+
+void ConsumerThreadPool::setThreadCount(uint32_t count) noexcept
+{
+    if (s_started)
+    {
+        g_warning("The consumer thread count must be set before the first view backend initialization");
+        return;
+    }
+
+    s_threadCount = count;
+}
+
+ConsumerThreadPool::ConsumerThreadPool(uint32_t threadCount) noexcept
+{
+    for (uint32_t i = 0; i < threadCount; ++i)
+        m_threads.emplace_back(&ConsumerThreadPool::workerThreadFunc, this);
+}
+
+void ConsumerThreadPool::addClient(Client& client) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    client.m_registered = true;
+    makeReady(client);
+}
+
+void ConsumerThreadPool::removeClient(Client& client) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!client.m_registered)
+        return;
+
+    client.m_registered = false;
+
+    // Waiting would deadlock, the worker sees that the client is unregistered once it returns
+    if (&client == t_runningClient)
+        return;
+
+    m_removalCondition.wait(lock, [&client] { return client.m_state != Client::State::Running; });
+
+    m_readyClients.erase(std::remove(m_readyClients.begin(), m_readyClients.end(), &client), m_readyClients.end());
+    m_polledClients.erase(std::remove_if(m_polledClients.begin(), m_polledClients.end(),
+                                         [&client](const PolledClient& polled) { return polled.client == &client; }),
+                          m_polledClients.end());
+    client.m_state = Client::State::Idle;
+    client.m_signaled = false;
+}
+
+bool ConsumerThreadPool::isRunningOnCurrentThread(const Client& client) noexcept
+{
+    return &client == t_runningClient;
+}
+
+void ConsumerThreadPool::signal(Client& client) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!client.m_registered)
+        return;
+
+    switch (client.m_state)
+    {
+    case Client::State::Idle:
+    case Client::State::Polling:
+        makeReady(client);
+        break;
+
+    case Client::State::Running:
+        client.m_signaled = true;
+        break;
+
+    case Client::State::Ready:
+        break;
+    }
+}
+
+void ConsumerThreadPool::makeReady(Client& client) noexcept
+{
+    // Any polling entry of the client becomes stale
+    client.m_state = Client::State::Ready;
+    m_readyClients.push_back(&client);
+    m_workerCondition.notify_one();
+}
+
+void ConsumerThreadPool::workerThreadFunc() noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        Client* client = nullptr;
+        if (!m_readyClients.empty())
+        {
+            client = m_readyClients.front();
+            m_readyClients.pop_front();
+        }
+        else if (!m_polledClients.empty())
+        {
+            const PolledClient polled = m_polledClients.front();
+            if ((polled.client->m_state != Client::State::Polling) ||
+                (polled.client->m_pollSequence != polled.sequence))
+            {
+                m_polledClients.pop_front();
+                continue;
+            }
+
+            const int64_t delay = polled.time - g_get_monotonic_time();
+            if (delay > 0)
+            {
+                m_workerCondition.wait_for(lock, std::chrono::microseconds(delay));
+                continue;
+            }
+
+            client = polled.client;
+            m_polledClients.pop_front();
+        }
+        else
+        {
+            m_workerCondition.wait(lock);
+            continue;
+        }
+
+        client->m_state = Client::State::Running;
+        client->m_signaled = false;
+        lock.unlock();
+
+        t_runningClient = client;
+        const Client::Schedule schedule = client->processFrameEvents();
+        t_runningClient = nullptr;
+        if (eglGetCurrentContext() != EGL_NO_CONTEXT)
+            eglMakeCurrent(eglGetCurrentDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+        lock.lock();
+        if (schedule != Client::Schedule::Backoff)
+            client->m_backoffInterval = 0;
+
+        if (!client->m_registered)
+        {
+            client->m_state = Client::State::Idle;
+            m_removalCondition.notify_all();
+        }
+        else if (client->m_signaled || (schedule == Client::Schedule::Continue))
+            makeReady(*client);
+        else if ((schedule == Client::Schedule::Poll) || (schedule == Client::Schedule::Backoff))
+        {
+            int64_t interval = POLL_INTERVAL_USEC;
+            if (schedule == Client::Schedule::Backoff)
+            {
+                if (client->m_backoffInterval)
+                    interval = std::min(2 * client->m_backoffInterval, MAX_BACKOFF_INTERVAL_USEC);
+                client->m_backoffInterval = interval;
+            }
+
+            // Appended most of the time, unless other clients are backing off
+            const PolledClient polled = {client, ++client->m_pollSequence, g_get_monotonic_time() + interval};
+            m_polledClients.insert(std::upper_bound(m_polledClients.begin(), m_polledClients.end(), polled,
+                                                    [](const PolledClient& first, const PolledClient& second) {
+                                                        return first.time < second.time;
+                                                    }),
+                                   polled);
+            client->m_state = Client::State::Polling;
+            m_workerCondition.notify_one();
+        }
+        else
+            client->m_state = Client::State::Idle;
+    }
+}
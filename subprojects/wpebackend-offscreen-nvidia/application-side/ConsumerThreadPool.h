@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Process-wide pool of worker threads running the frame consumers of all the views, so that the number of threads
+// scales with the CPU cores instead of the number of views. A client is run by a single worker at a time, and only
+// once it has been signaled or its polling interval has elapsed. It is started on first use and runs until the process
+// exits.
+class ConsumerThreadPool final
+{
+  public:
+    // Clients which cannot be signaled for some events (pending GPU copies, frames announced but not available yet in
+    // their EGLStream) are polled at this interval, well below a frame period
+    static constexpr int64_t POLL_INTERVAL_USEC = 2 * 1000;
+    // Clients polling for events which may not happen for a long time (EGLStream peers not announcing their frames)
+    // back off up to this interval, about a frame period
+    static constexpr int64_t MAX_BACKOFF_INTERVAL_USEC = 16 * 1000;
+
+    class Client
+    {
+      public:
+        enum class Schedule
+        {
+            // Run again once signaled
+            Wait,
+            // Run again after the polling interval, or once signaled
+            Poll,
+            // Same as Poll, but the interval doubles each time the client backs off again in a row, up to the maximum
+            Backoff,
+            // Run again right away, after the other ready clients
+            Continue
+        };
+
+        virtual ~Client() = default;
+
+        // Processes the pending frame events without blocking. It may run on a different worker each time, so the
+        // EGLContexts made current by a client are released by the worker afterwards.
+        virtual Schedule processFrameEvents() noexcept = 0;
+
+      private:
+        friend class ConsumerThreadPool;
+
+        enum class State
+        {
+            Idle,
+            Ready,
+            Polling,
+            Running
+        };
+        State m_state = State::Idle;
+        bool m_registered = false;
+        bool m_signaled = false;
+        uint64_t m_pollSequence = 0;
+        int64_t m_backoffInterval = 0;
+    };
+
+    static ConsumerThreadPool& getInstance() noexcept;
+
+    // Must be called before the pool is started, 0 restoring the default of half the CPU cores
+    static void setThreadCount(uint32_t count) noexcept;
+
+    ConsumerThreadPool(ConsumerThreadPool&&) = delete;
+    ConsumerThreadPool& operator=(ConsumerThreadPool&&) = delete;
+    ConsumerThreadPool(const ConsumerThreadPool&) = delete;
+    ConsumerThreadPool& operator=(const ConsumerThreadPool&) = delete;
+
+    // The client is run once right after being added
+    void addClient(Client& client) noexcept;
+    // Waits for the client to finish running, if it is, it is never run again afterwards. When called from the client
+    // itself, the removal is completed by its worker once it returns, and the client must stay alive until then.
+    void removeClient(Client& client) noexcept;
+    // True when called from the worker currently running the client
+    static bool isRunningOnCurrentThread(const Client& client) noexcept;
+    // Can be called from any thread, signals received while the client is running make it run again
+    void signal(Client& client) noexcept;
+
+  private:
+    explicit ConsumerThreadPool(uint32_t threadCount) noexcept;
+    ~ConsumerThreadPool() = delete;
+
+    std::mutex m_mutex;
+    std::condition_variable m_workerCondition;
+    std::condition_variable m_removalCondition;
+    std::deque<Client*> m_readyClients;
+
+    // Sorted by time. Entries of clients signaled or removed in between are stale.
+    struct PolledClient
+    {
+        Client* client;
+        uint64_t sequence;
+        int64_t time;
+    };
+    std::deque<PolledClient> m_polledClients;
+
+    std::vector<std::thread> m_threads;
+    void workerThreadFunc() noexcept;
+    void makeReady(Client& client) noexcept;
+};
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DamageTracker.h"
+
+#include <GLES2/gl2ext.h>
+#include <glib.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = nullptr;
+
+// Loaded once for the whole process, as the instances of several views may be created concurrently by pool workers
+bool initGLExtensions() noexcept
+{
+    static std::once_flag s_loaded;
+    std::call_once(s_loaded, [] {
+        glEGLImageTargetTexture2DOES =
+            reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    });
+
+    return glEGLImageTargetTexture2DOES != nullptr;
+}
+
+// Triangle covering the whole viewport, without any vertex attribute
+constexpr const char* VERTEX_SHADER = R"(#version 300 es
+void main()
+{
+    vec2 position = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+// Each fragment covers one tile, and is set as soon as one of its pixels changed
+constexpr const char* FRAGMENT_SHADER = R"(#version 300 es
+precision highp float;
+precision highp int;
+
+uniform highp sampler2D u_current;
+uniform highp sampler2D u_previous;
+uniform ivec2 u_size;
+uniform int u_tileSize;
+
+out vec4 o_color;
+
+void main()
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy) * u_tileSize;
+    ivec2 end = min(origin + ivec2(u_tileSize), u_size);
+    for (int y = origin.y; y < end.y; ++y)
+    {
+        for (int x = origin.x; x < end.x; ++x)
+        {
+            if (texelFetch(u_current, ivec2(x, y), 0) != texelFetch(u_previous, ivec2(x, y), 0))
+            {
+                o_color = vec4(1.0);
+                return;
+            }
+        }
+    }
+    o_color = vec4(0.0);
+})";
+
+GLuint compileShader(GLenum type, const char* source) noexcept
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[512] = {};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        g_warning("Cannot compile the damage tracking shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+constexpr uint32_t BYTES_PER_TILE = 4;
+} // namespace
+
+std::unique_ptr<DamageTracker> DamageTracker::create(EGLDisplay display) noexcept
+{
+    if (!display || !eglBindAPI(EGL_OPENGL_ES_API))
+        return nullptr;
+
+    // No surface is ever used, so any config supporting OpenGL ES 3 fits when configless contexts are not supported
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!FrameTransport::hasEGLExtensions(display, {"EGL_KHR_no_config_context"}))
+    {
+        static constexpr const EGLint s_configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_NONE};
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, s_configAttribs, &config, 1, &numConfigs) || (numConfigs != 1))
+            return nullptr;
+    }
+
+    std::unique_ptr<DamageTracker> tracker(new DamageTracker(display));
+
+    static constexpr const EGLint s_contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    tracker->m_eglContext = eglCreateContext(display, config, EGL_NO_CONTEXT, s_contextAttribs);
+    if (!tracker->m_eglContext)
+        return nullptr;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, tracker->m_eglContext) || !initGLExtensions() ||
+        !tracker->createProgram())
+    {
+        return nullptr;
+    }
+
+    return tracker;
+}
+
+DamageTracker::~DamageTracker()
+{
+    if (!m_eglContext)
+        return;
+
+    if (eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        deleteFence();
+        deleteTextures();
+        for (SlotTexture& slotTexture : m_slotTextures)
+        {
+            glDeleteFramebuffers(1, &slotTexture.framebuffer);
+            glDeleteTextures(1, &slotTexture.texture);
+        }
+
+        glDeleteVertexArrays(1, &m_vertexArray);
+        glDeleteProgram(m_program);
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    eglDestroyContext(m_display, m_eglContext);
+}
+
+bool DamageTracker::createProgram() noexcept
+{
+    const GLuint vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+    const GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+
+    m_program = glCreateProgram();
+    glAttachShader(m_program, vertexShader);
+    glAttachShader(m_program, fragmentShader);
+    glLinkProgram(m_program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(m_program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        g_warning("Cannot link the damage tracking program");
+        return false;
+    }
+
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "u_current"), 0);
+    glUniform1i(glGetUniformLocation(m_program, "u_previous"), 1);
+    glUniform1i(glGetUniformLocation(m_program, "u_tileSize"), static_cast<GLint>(TILE_SIZE));
+    m_sizeLocation = glGetUniformLocation(m_program, "u_size");
+    glUseProgram(0);
+
+    glGenVertexArrays(1, &m_vertexArray);
+    return true;
+}
+
+const DamageTracker::SlotTexture* DamageTracker::getSlotTexture(const FrameConsumer::Frame& frame) noexcept
+{
+    if (frame.slot >= m_slotTextures.size())
+        m_slotTextures.resize(frame.slot + 1);
+
+    SlotTexture& slotTexture = m_slotTextures[frame.slot];
+    if (slotTexture.framebuffer && (slotTexture.generation == frame.slotGeneration))
+        return &slotTexture;
+
+    // New slot, or slot image replaced since the last time it was compared
+    if (!slotTexture.texture)
+        glGenTextures(1, &slotTexture.texture);
+    if (!slotTexture.framebuffer)
+        glGenFramebuffers(1, &slotTexture.framebuffer);
+
+    glBindTexture(GL_TEXTURE_2D, slotTexture.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, frame.image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, slotTexture.framebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slotTexture.texture, 0);
+    const bool complete = (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        g_warning("Damage cannot be tracked on the frame image of slot %u", frame.slot);
+        slotTexture.generation = 0;
+        return nullptr;
+    }
+
+    slotTexture.generation = frame.slotGeneration;
+    return &slotTexture;
+}
+
+bool DamageTracker::resize(uint32_t width, uint32_t height) noexcept
+{
+    deleteTextures();
+
+    const uint32_t columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    auto createTarget = [](GLuint& texture, GLuint& framebuffer, uint32_t targetWidth, uint32_t targetHeight) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, static_cast<GLsizei>(targetWidth),
+                       static_cast<GLsizei>(targetHeight));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        const bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return complete;
+    };
+
+    if (!createTarget(m_previousTexture, m_previousFramebuffer, width, height) ||
+        !createTarget(m_tilesTexture, m_tilesFramebuffer, columns, rows))
+    {
+        g_warning("Cannot allocate the damage tracking buffers for a %ux%u frame", width, height);
+        deleteTextures();
+        return false;
+    }
+
+    m_tiles.resize(static_cast<size_t>(columns) * rows * BYTES_PER_TILE);
+    glGenBuffers(1, &m_tilesBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_tilesBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(m_tiles.size()), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void DamageTracker::deleteTextures() noexcept
+{
+    glDeleteFramebuffers(1, &m_previousFramebuffer);
+    glDeleteTextures(1, &m_previousTexture);
+    glDeleteFramebuffers(1, &m_tilesFramebuffer);
+    glDeleteTextures(1, &m_tilesTexture);
+    glDeleteBuffers(1, &m_tilesBuffer);
+    m_previousFramebuffer = 0;
+    m_previousTexture = 0;
+    m_tilesFramebuffer = 0;
+    m_tilesTexture = 0;
+    m_tilesBuffer = 0;
+    m_width = 0;
+    m_height = 0;
+}
+
+void DamageTracker::submitFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept
+{
+    setFullDamage(width, height);
+    if (!frame.image || !width || !height ||
+        !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        return;
+    }
+
+    // Only one comparison is running at a time
+    deleteFence();
+
+    if (frame.acquireSync)
+        eglWaitSync(m_display, frame.acquireSync, 0);
+
+    const SlotTexture* slotTexture = getSlotTexture(frame);
+    if (!slotTexture)
+        return;
+
+    // Nothing to compare with on the first frame, or when the size changed
+    const bool hasPreviousFrame = (width == m_width) && (height == m_height);
+    if (!hasPreviousFrame && !resize(width, height))
+        return;
+
+    const uint32_t columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    if (hasPreviousFrame)
+    {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_tilesFramebuffer);
+        glViewport(0, 0, static_cast<GLsizei>(columns), static_cast<GLsizei>(rows));
+        glUseProgram(m_program);
+        glUniform2i(m_sizeLocation, static_cast<GLint>(width), static_cast<GLint>(height));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, slotTexture->texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_previousTexture);
+        glBindVertexArray(m_vertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glUseProgram(0);
+    }
+
+    // The frame content is kept for the next comparison
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, slotTexture->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_previousFramebuffer);
+    const GLint blitWidth = static_cast<GLint>(width);
+    const GLint blitHeight = static_cast<GLint>(height);
+    glBlitFramebuffer(0, 0, blitWidth, blitHeight, 0, 0, blitWidth, blitHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    if (hasPreviousFrame)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_tilesFramebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_tilesBuffer);
+        glReadPixels(0, 0, static_cast<GLsizei>(columns), static_cast<GLsizei>(rows), GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // The frame image must not be read anymore once it is released to the producer, which the fence tells
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_tilesPending = hasPreviousFrame;
+    glFlush();
+}
+
+bool DamageTracker::pollDamage() noexcept
+{
+    if (!m_fence)
+        return true;
+
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+        return false;
+
+    const GLenum status = glClientWaitSync(m_fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    const bool tilesPending = m_tilesPending;
+    deleteFence();
+    if (!tilesPending || (status == GL_WAIT_FAILED))
+        return true;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_tilesBuffer);
+    const void* tiles =
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(m_tiles.size()), GL_MAP_READ_BIT);
+    if (tiles)
+    {
+        std::copy_n(static_cast<const uint8_t*>(tiles), m_tiles.size(), m_tiles.begin());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        buildDamage((m_width + TILE_SIZE - 1) / TILE_SIZE, (m_height + TILE_SIZE - 1) / TILE_SIZE);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void DamageTracker::deleteFence() noexcept
+{
+    if (m_fence)
+        glDeleteSync(m_fence);
+    m_fence = nullptr;
+    m_tilesPending = false;
+}
+
+void DamageTracker::setFullDamage(uint32_t width, uint32_t height) noexcept
+{
+    m_damage.clear();
+    if (width && height)
+        m_damage.push_back({0, 0, width, height});
+}
+
+void DamageTracker::buildDamage(uint32_t columns, uint32_t rows) noexcept
+{
+    auto isTileDamaged = [this, columns](uint32_t column, uint32_t row) {
+        return m_tiles[(static_cast<size_t>(row) * columns + column) * BYTES_PER_TILE] != 0;
+    };
+
+    // Runs of damaged tiles within a row are merged, and extended over the following rows having the same run
+    m_damage.clear();
+    for (uint32_t row = 0; (row < rows) && (m_damage.size() <= MAX_RECT_COUNT); ++row)
+    {
+        uint32_t column = 0;
+        while (column < columns)
+        {
+            if (!isTileDamaged(column, row))
+            {
+                ++column;
+                continue;
+            }
+
+            const uint32_t start = column;
+            while ((column < columns) && isTileDamaged(column, row))
+                ++column;
+
+            const Rect rect = {start * TILE_SIZE, row * TILE_SIZE,
+                               std::min(column * TILE_SIZE, m_width) - start * TILE_SIZE,
+                               std::min((row + 1) * TILE_SIZE, m_height) - row * TILE_SIZE};
+            auto above = std::find_if(m_damage.begin(), m_damage.end(), [&rect](const Rect& damage) {
+                return (damage.x == rect.x) && (damage.width == rect.width) && (damage.y + damage.height == rect.y);
+            });
+            if (above != m_damage.end())
+                above->height += rect.height;
+            else
+                m_damage.push_back(rect);
+        }
+    }
+
+    if (m_damage.size() <= MAX_RECT_COUNT)
+        return;
+
+    // Too fragmented, the bounding box of the damaged tiles is cheaper to process for the application
+    uint32_t minColumn = columns, minRow = rows, maxColumn = 0, maxRow = 0;
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        for (uint32_t column = 0; column < columns; ++column)
+        {
+            if (isTileDamaged(column, row))
+            {
+                minColumn = std::min(minColumn, column);
+                minRow = std::min(minRow, row);
+                maxColumn = std::max(maxColumn, column);
+                maxRow = std::max(maxRow, row);
+            }
+        }
+    }
+
+    m_damage.clear();
+    m_damage.push_back({minColumn * TILE_SIZE, minRow * TILE_SIZE,
+                        std::min((maxColumn + 1) * TILE_SIZE, m_width) - minColumn * TILE_SIZE,
+                        std::min((maxRow + 1) * TILE_SIZE, m_height) - minRow * TILE_SIZE});
+}
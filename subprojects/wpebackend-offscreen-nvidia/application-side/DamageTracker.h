@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../common/FrameTransport.h"
+
+#include <GLES3/gl3.h>
+
+#include <memory>
+#include <vector>
+
+// Computes the regions of a frame which changed since the previous one. The frame transports only hand over whole
+// images, so the frame is compared on the GPU, tile by tile, with a copy of the previous one kept by the tracker. The
+// comparison is never waited for, its result is polled.
+// Like PixelReadback, calls are serialized per view but may come from different threads, and each method makes the
+// context current first.
+class DamageTracker final
+{
+  public:
+    static constexpr uint32_t TILE_SIZE = 32;
+    // Above this count, the damage is reduced to its bounding box
+    static constexpr size_t MAX_RECT_COUNT = 16;
+
+    // Rectangles in pixels, with the origin at the bottom-left corner of the frame
+    struct Rect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Creates the EGLContext used for the comparisons
+    static std::unique_ptr<DamageTracker> create(EGLDisplay display) noexcept;
+
+    ~DamageTracker();
+
+    DamageTracker(DamageTracker&&) = delete;
+    DamageTracker& operator=(DamageTracker&&) = delete;
+    DamageTracker(const DamageTracker&) = delete;
+    DamageTracker& operator=(const DamageTracker&) = delete;
+
+    // Queues the comparison of the bottom-left width x height area of the frame with the previous frame
+    void submitFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept;
+
+    // Returns false while the submitted comparison is still running. Once it returns true, the frame image is not used
+    // anymore and the damage is available.
+    bool pollDamage() noexcept;
+
+    // Damaged regions of the last submitted frame, none if it is identical to the previous one, and the whole area on
+    // the first frame or on error
+    const std::vector<Rect>& getDamage() const noexcept
+    {
+        return m_damage;
+    }
+
+  private:
+    DamageTracker(EGLDisplay display) noexcept : m_display(display)
+    {
+    }
+
+    const EGLDisplay m_display;
+    EGLContext m_eglContext = EGL_NO_CONTEXT;
+    GLuint m_program = 0;
+    GLint m_sizeLocation = -1;
+    GLuint m_vertexArray = 0;
+
+    // Frame images are bound to textures once per frame consumer slot
+    struct SlotTexture
+    {
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        uint32_t generation = 0;
+    };
+    std::vector<SlotTexture> m_slotTextures;
+
+    // Copy of the previous frame content
+    GLuint m_previousTexture = 0;
+    GLuint m_previousFramebuffer = 0;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+
+    // One texel per tile, set when the tile changed, read back into a pixel pack buffer
+    GLuint m_tilesTexture = 0;
+    GLuint m_tilesFramebuffer = 0;
+    GLuint m_tilesBuffer = 0;
+    std::vector<uint8_t> m_tiles;
+
+    // Signaled once the comparison and the copy of the frame are complete
+    GLsync m_fence = nullptr;
+    bool m_tilesPending = false;
+
+    std::vector<Rect> m_damage;
+
+    bool createProgram() noexcept;
+    const SlotTexture* getSlotTexture(const FrameConsumer::Frame& frame) noexcept;
+    bool resize(uint32_t width, uint32_t height) noexcept;
+    void deleteTextures() noexcept;
+    void setFullDamage(uint32_t width, uint32_t height) noexcept;
+    void deleteFence() noexcept;
+    void buildDamage(uint32_t columns, uint32_t rows) noexcept;
+};
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "EGLDeviceSelector.h"
+
+#include "../common/EGLDevice.h"
+
+#include <glib.h>
+
+#include <mutex>
+#include <vector>
+
+namespace
+{
+// Called from the main thread when launching WPEWebProcesses, and from the IPC dispatch threads of the views
+std::mutex s_mutex;
+wpe_offscreen_nvidia_egl_device_policy s_policy = WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_DEFAULT;
+int32_t s_fixedDevice = EGLDevice::DEFAULT_DEVICE;
+uint32_t s_nextDevice = 0;
+std::vector<uint32_t> s_loads;
+
+bool isValidDevice(int32_t device) noexcept
+{
+    return (device >= 0) && (device < static_cast<int32_t>(s_loads.size()));
+}
+} // namespace
+
+void EGLDeviceSelector::setPolicy(wpe_offscreen_nvidia_egl_device_policy policy, int32_t device) noexcept
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+    s_policy = policy;
+    s_fixedDevice = device;
+}
+
+int32_t EGLDeviceSelector::selectDevice() noexcept
+{
+    const int32_t deviceCount = EGLDevice::getDeviceCount();
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+    s_loads.resize(static_cast<size_t>(deviceCount));
+
+    int32_t device = EGLDevice::DEFAULT_DEVICE;
+    switch (s_policy)
+    {
+    case WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_DEFAULT:
+        break;
+
+    case WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_FIXED:
+        if (isValidDevice(s_fixedDevice))
+            device = s_fixedDevice;
+        else
+            g_warning("EGL device %d is not available (%d devices), the default one is used", s_fixedDevice,
+                      deviceCount);
+        break;
+
+    case WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_ROUND_ROBIN:
+        if (deviceCount > 0)
+            device = static_cast<int32_t>(s_nextDevice++ % static_cast<uint32_t>(deviceCount));
+        break;
+
+    case WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_LEAST_LOADED:
+        // The first device wins on equal loads
+        for (int32_t i = 0; i < deviceCount; ++i)
+        {
+            if ((device == EGLDevice::DEFAULT_DEVICE) || (s_loads[i] < s_loads[device]))
+                device = i;
+        }
+        break;
+    }
+
+    if (isValidDevice(device))
+        ++s_loads[device];
+
+    return device;
+}
+
+void EGLDeviceSelector::addLoad(int32_t device) noexcept
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (isValidDevice(device))
+        ++s_loads[device];
+}
+
+void EGLDeviceSelector::removeLoad(int32_t device) noexcept
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (isValidDevice(device) && (s_loads[device] > 0))
+        --s_loads[device];
+}
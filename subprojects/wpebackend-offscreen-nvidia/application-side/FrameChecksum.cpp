@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FrameChecksum.h"
+
+#include <GLES2/gl2ext.h>
+#include <glib.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = nullptr;
+
+// Loaded once for the whole process, as the instances of several views may be created concurrently by pool workers
+bool initGLExtensions() noexcept
+{
+    static std::once_flag s_loaded;
+    std::call_once(s_loaded, [] {
+        glEGLImageTargetTexture2DOES =
+            reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    });
+
+    return glEGLImageTargetTexture2DOES != nullptr;
+}
+
+// Triangle covering the whole viewport, without any vertex attribute
+constexpr const char* VERTEX_SHADER = R"(#version 300 es
+void main()
+{
+    vec2 position = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+// Each fragment covers one block, hashed with FNV-1a over its pixels, and stores the 32-bit hash in its 4 channels
+constexpr const char* FRAGMENT_SHADER = R"(#version 300 es
+precision highp float;
+precision highp int;
+
+uniform highp sampler2D u_frame;
+uniform ivec2 u_size;
+uniform int u_blockSize;
+
+out vec4 o_color;
+
+void main()
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy) * u_blockSize;
+    ivec2 end = min(origin + ivec2(u_blockSize), u_size);
+    uint hash = 2166136261u;
+    for (int y = origin.y; y < end.y; ++y)
+    {
+        for (int x = origin.x; x < end.x; ++x)
+        {
+            uvec4 texel = uvec4(texelFetch(u_frame, ivec2(x, y), 0) * 255.0 + 0.5);
+            hash = (hash ^ (texel.r | (texel.g << 8) | (texel.b << 16) | (texel.a << 24))) * 16777619u;
+        }
+    }
+    o_color = vec4((uvec4(hash, hash >> 8, hash >> 16, hash >> 24) & 255u)) / 255.0;
+})";
+
+GLuint compileShader(GLenum type, const char* source) noexcept
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+        char log[512] = {};
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        g_warning("Cannot compile the frame checksum shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+constexpr uint32_t BYTES_PER_HASH = 4;
+} // namespace
+
+std::unique_ptr<FrameChecksum> FrameChecksum::create(EGLDisplay display) noexcept
+{
+    if (!display || !eglBindAPI(EGL_OPENGL_ES_API))
+        return nullptr;
+
+    // No surface is ever used, so any config supporting OpenGL ES 3 fits when configless contexts are not supported
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!FrameTransport::hasEGLExtensions(display, {"EGL_KHR_no_config_context"}))
+    {
+        static constexpr const EGLint s_configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_NONE};
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, s_configAttribs, &config, 1, &numConfigs) || (numConfigs != 1))
+            return nullptr;
+    }
+
+    std::unique_ptr<FrameChecksum> checksum(new FrameChecksum(display));
+
+    static constexpr const EGLint s_contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    checksum->m_eglContext = eglCreateContext(display, config, EGL_NO_CONTEXT, s_contextAttribs);
+    if (!checksum->m_eglContext)
+        return nullptr;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, checksum->m_eglContext) || !initGLExtensions() ||
+        !checksum->createProgram())
+    {
+        return nullptr;
+    }
+
+    return checksum;
+}
+
+FrameChecksum::~FrameChecksum()
+{
+    if (!m_eglContext)
+        return;
+
+    if (eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        if (m_fence)
+            glDeleteSync(m_fence);
+
+        deleteTargets();
+        for (SlotTexture& slotTexture : m_slotTextures)
+            glDeleteTextures(1, &slotTexture.texture);
+
+        glDeleteVertexArrays(1, &m_vertexArray);
+        glDeleteProgram(m_program);
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    eglDestroyContext(m_display, m_eglContext);
+}
+
+bool FrameChecksum::createProgram() noexcept
+{
+    const GLuint vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+    const GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
+    }
+
+    m_program = glCreateProgram();
+    glAttachShader(m_program, vertexShader);
+    glAttachShader(m_program, fragmentShader);
+    glLinkProgram(m_program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(m_program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        g_warning("Cannot link the frame checksum program");
+        return false;
+    }
+
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "u_frame"), 0);
+    glUniform1i(glGetUniformLocation(m_program, "u_blockSize"), static_cast<GLint>(BLOCK_SIZE));
+    m_sizeLocation = glGetUniformLocation(m_program, "u_size");
+    glUseProgram(0);
+
+    glGenVertexArrays(1, &m_vertexArray);
+    return true;
+}
+
+GLuint FrameChecksum::getSlotTexture(const FrameConsumer::Frame& frame) noexcept
+{
+    if (frame.slot >= m_slotTextures.size())
+        m_slotTextures.resize(frame.slot + 1);
+
+    // New slot, or slot image replaced since the last time it was hashed
+    SlotTexture& slotTexture = m_slotTextures[frame.slot];
+    if (!slotTexture.texture || (slotTexture.generation != frame.slotGeneration))
+    {
+        if (!slotTexture.texture)
+            glGenTextures(1, &slotTexture.texture);
+
+        glBindTexture(GL_TEXTURE_2D, slotTexture.texture);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, frame.image);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        slotTexture.generation = frame.slotGeneration;
+    }
+
+    return slotTexture.texture;
+}
+
+bool FrameChecksum::resize(uint32_t width, uint32_t height) noexcept
+{
+    deleteTargets();
+
+    const uint32_t columns = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint32_t rows = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    glGenTextures(1, &m_hashesTexture);
+    glBindTexture(GL_TEXTURE_2D, m_hashesTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, static_cast<GLsizei>(columns), static_cast<GLsizei>(rows));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_hashesFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_hashesFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_hashesTexture, 0);
+    const bool complete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        g_warning("Cannot allocate the frame checksum buffers for a %ux%u frame", width, height);
+        deleteTargets();
+        return false;
+    }
+
+    m_hashes.resize(static_cast<size_t>(columns) * rows * BYTES_PER_HASH);
+    glGenBuffers(1, &m_hashesBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_hashesBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(m_hashes.size()), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+void FrameChecksum::deleteTargets() noexcept
+{
+    glDeleteFramebuffers(1, &m_hashesFramebuffer);
+    glDeleteTextures(1, &m_hashesTexture);
+    glDeleteBuffers(1, &m_hashesBuffer);
+    m_hashesFramebuffer = 0;
+    m_hashesTexture = 0;
+    m_hashesBuffer = 0;
+    m_width = 0;
+    m_height = 0;
+    m_hasPreviousHashes = false;
+}
+
+void FrameChecksum::submitFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept
+{
+    m_result = Result::Changed;
+    if (!frame.image || !width || !height ||
+        !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        m_hasPreviousHashes = false;
+        return;
+    }
+
+    // Only one frame is hashed at a time
+    if (m_fence)
+    {
+        glDeleteSync(m_fence);
+        m_fence = nullptr;
+    }
+
+    if (frame.acquireSync)
+        eglWaitSync(m_display, frame.acquireSync, 0);
+
+    const GLuint texture = getSlotTexture(frame);
+    if (((width != m_width) || (height != m_height)) && !resize(width, height))
+        return;
+
+    const uint32_t columns = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const uint32_t rows = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    glBindFramebuffer(GL_FRAMEBUFFER, m_hashesFramebuffer);
+    glViewport(0, 0, static_cast<GLsizei>(columns), static_cast<GLsizei>(rows));
+    glUseProgram(m_program);
+    glUniform2i(m_sizeLocation, static_cast<GLint>(width), static_cast<GLint>(height));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(m_vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_hashesBuffer);
+    glReadPixels(0, 0, static_cast<GLsizei>(columns), static_cast<GLsizei>(rows), GL_RGBA, GL_UNSIGNED_BYTE,
+                 nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // The frame image must not be read anymore once it is released to the producer, which the fence tells
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+FrameChecksum::Result FrameChecksum::pollResult() noexcept
+{
+    if (!m_fence)
+        return m_result;
+
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+        return Result::Pending;
+
+    const GLenum status = glClientWaitSync(m_fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return Result::Pending;
+
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_hashesBuffer);
+    const void* hashes = nullptr;
+    if (status != GL_WAIT_FAILED)
+        hashes = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(m_hashes.size()), GL_MAP_READ_BIT);
+    if (hashes)
+    {
+        // The previous hashes are replaced, as a changed frame is the reference of the next comparison
+        const uint8_t* data = static_cast<const uint8_t*>(hashes);
+        if (m_hasPreviousHashes && std::equal(m_hashes.begin(), m_hashes.end(), data))
+            m_result = Result::Unchanged;
+        else
+            std::copy_n(data, m_hashes.size(), m_hashes.begin());
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_hasPreviousHashes = (hashes != nullptr);
+    return m_result;
+}
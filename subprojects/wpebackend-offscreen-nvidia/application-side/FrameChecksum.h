@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../common/FrameTransport.h"
+
+#include <GLES3/gl3.h>
+
+#include <memory>
+#include <vector>
+
+// Tells whether a frame is identical to the previous one, much cheaper than the DamageTracker: the frame is reduced on
+// the GPU to one hash per block of pixels, and only these hashes are read back and compared with the previous ones,
+// without keeping any copy of the previous frame. The hashes are read back asynchronously, their result is polled.
+// Like DamageTracker, calls are serialized per view but may come from different threads, and each method makes the
+// context current first.
+class FrameChecksum final
+{
+  public:
+    static constexpr uint32_t BLOCK_SIZE = 16;
+
+    enum class Result
+    {
+        Pending,
+        Changed,
+        Unchanged
+    };
+
+    // Creates the EGLContext used for the hashing
+    static std::unique_ptr<FrameChecksum> create(EGLDisplay display) noexcept;
+
+    ~FrameChecksum();
+
+    FrameChecksum(FrameChecksum&&) = delete;
+    FrameChecksum& operator=(FrameChecksum&&) = delete;
+    FrameChecksum(const FrameChecksum&) = delete;
+    FrameChecksum& operator=(const FrameChecksum&) = delete;
+
+    // Queues the hashing of the bottom-left width x height area of the frame
+    void submitFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept;
+
+    // Returns Pending while the hashes of the submitted frame are computed, the frame image is not used anymore once
+    // another result is returned. The first frame, a frame with another size than the previous one, and a frame which
+    // cannot be hashed are considered as changed.
+    Result pollResult() noexcept;
+
+  private:
+    FrameChecksum(EGLDisplay display) noexcept : m_display(display)
+    {
+    }
+
+    const EGLDisplay m_display;
+    EGLContext m_eglContext = EGL_NO_CONTEXT;
+    GLuint m_program = 0;
+    GLint m_sizeLocation = -1;
+    GLuint m_vertexArray = 0;
+
+    // Frame images are bound to textures once per frame consumer slot
+    struct SlotTexture
+    {
+        GLuint texture = 0;
+        uint32_t generation = 0;
+    };
+    std::vector<SlotTexture> m_slotTextures;
+
+    // One texel per block holding its hash, read back into a pixel pack buffer
+    GLuint m_hashesTexture = 0;
+    GLuint m_hashesFramebuffer = 0;
+    GLuint m_hashesBuffer = 0;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<uint8_t> m_hashes;
+    bool m_hasPreviousHashes = false;
+
+    // Signaled once the hashes are in the pixel pack buffer
+    GLsync m_fence = nullptr;
+    Result m_result = Result::Changed;
+
+    bool createProgram() noexcept;
+    GLuint getSlotTexture(const FrameConsumer::Frame& frame) noexcept;
+    bool resize(uint32_t width, uint32_t height) noexcept;
+    void deleteTargets() noexcept;
+};
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FrameHandoff.h"
+
+#include <cerrno>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+std::unique_ptr<FrameHandoff> FrameHandoff::create() noexcept
+{
+    std::unique_ptr<FrameHandoff> handoff(new FrameHandoff());
+    handoff->m_eventFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (handoff->m_eventFD == -1)
+        return nullptr;
+
+    return handoff;
+}
+
+FrameHandoff::~FrameHandoff()
+{
+    if (m_eventFD != -1)
+        close(m_eventFD);
+}
+
+void FrameHandoff::publish(EGLImage frame) noexcept
+{
+    m_frame = frame;
+    ringEventFD();
+}
+
+void FrameHandoff::notify() noexcept
+{
+    m_notified = true;
+    ringEventFD();
+}
+
+void FrameHandoff::ringEventFD() noexcept
+{
+    const uint64_t value = 1;
+    while ((write(m_eventFD, &value, sizeof(value)) == -1) && (errno == EINTR))
+        continue;
+}
+
+EGLImage FrameHandoff::take() noexcept
+{
+    // A frame published between both calls is taken right away, the eventfd then wakes the delivering thread for
+    // nothing once
+    uint64_t value = 0;
+    while ((read(m_eventFD, &value, sizeof(value)) == -1) && (errno == EINTR))
+        continue;
+
+    return m_frame.exchange(EGL_NO_IMAGE);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+
+#include <atomic>
+#include <memory>
+
+// Hands the frames acquired by a consumer worker over to the thread delivering them, through a single slot without
+// any lock. The eventfd is rung on each publication, so that the delivering thread can watch it from its main context.
+class FrameHandoff final
+{
+  public:
+    static std::unique_ptr<FrameHandoff> create() noexcept;
+    ~FrameHandoff();
+
+    FrameHandoff(FrameHandoff&&) = delete;
+    FrameHandoff& operator=(FrameHandoff&&) = delete;
+    FrameHandoff(const FrameHandoff&) = delete;
+    FrameHandoff& operator=(const FrameHandoff&) = delete;
+
+    int getFD() const noexcept
+    {
+        return m_eventFD;
+    }
+
+    // Consumer side, the previously published frame must have been taken. The data written before are visible to the
+    // delivering thread once it gets the frame.
+    void publish(EGLImage frame) noexcept;
+    // Consumer side, wakes the delivering thread up without any frame, for frames already given back to the producer
+    void notify() noexcept;
+
+    // Delivering side, the frame is left in the slot
+    EGLImage peek() const noexcept
+    {
+        return m_frame.load();
+    }
+
+    // Delivering side, returns EGL_NO_IMAGE when the slot is empty
+    EGLImage take() noexcept;
+    // Delivering side, returns whether notify was called since the last time, to be called after take
+    bool takeNotification() noexcept
+    {
+        return m_notified.exchange(false);
+    }
+
+  private:
+    FrameHandoff() = default;
+
+    int m_eventFD = -1;
+    std::atomic<EGLImage> m_frame = EGL_NO_IMAGE;
+    std::atomic<bool> m_notified = false;
+
+    void ringEventFD() noexcept;
+};
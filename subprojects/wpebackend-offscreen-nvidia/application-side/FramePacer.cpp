@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FramePacer.h"
+
+#include <glib.h>
+
+#include <algorithm>
+
+FramePacer::FramePacer(Clock clock) noexcept : m_clock(clock ? clock : g_get_monotonic_time)
+{
+}
+
+void FramePacer::setTargetFPS(uint32_t fps) noexcept
+{
+    m_targetFPS = fps;
+    m_frameInterval = fps ? (G_USEC_PER_SEC / fps) : 0;
+
+    // The new rate applies from the next frame
+    m_nextFrameTime = 0;
+}
+
+int64_t FramePacer::getFrameDelay() const noexcept
+{
+    if (!m_frameInterval)
+        return 0;
+
+    return std::max<int64_t>(m_nextFrameTime - m_clock(), 0);
+}
+
+void FramePacer::frameDisplayed() noexcept
+{
+    if (!m_frameInterval)
+        return;
+
+    // Frames are scheduled on a fixed grid, so that the rate doesn't drift with the dispatch latency. When a frame is
+    // late by more than an interval (slow page, idle view), the grid restarts from now instead of allowing a burst.
+    const int64_t now = m_clock();
+    if (m_nextFrameTime && ((now - m_nextFrameTime) < m_frameInterval))
+        m_nextFrameTime += m_frameInterval;
+    else
+        m_nextFrameTime = now + m_frameInterval;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Paces the frame displayed notifications given to WebKit to a target frame rate, so that the WPEWebProcess only
+// renders frames at that rate. The clock is injectable, so that the pacing can be driven by a fake time source.
+class FramePacer final
+{
+  public:
+    // Returns a monotonic time in microseconds
+    using Clock = int64_t (*)();
+
+    // Uses g_get_monotonic_time when no clock is given
+    explicit FramePacer(Clock clock = nullptr) noexcept;
+
+    FramePacer(FramePacer&&) = delete;
+    FramePacer& operator=(FramePacer&&) = delete;
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // A target of 0 disables the pacing
+    void setTargetFPS(uint32_t fps) noexcept;
+    uint32_t getTargetFPS() const noexcept
+    {
+        return m_targetFPS;
+    }
+
+    // Returns the time in microseconds to wait before notifying the next frame as displayed, 0 if it can be right away
+    int64_t getFrameDelay() const noexcept;
+
+    // Must be called when the frame displayed notification is dispatched
+    void frameDisplayed() noexcept;
+
+  private:
+    const Clock m_clock;
+    uint32_t m_targetFPS = 0;
+    int64_t m_frameInterval = 0;
+    int64_t m_nextFrameTime = 0;
+};
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "PixelReadback.h"
+
+#include <GLES2/gl2ext.h>
+#include <glib.h>
+
+#include <mutex>
+
+namespace
+{
+PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES = nullptr;
+
+// Loaded once for the whole process, as the instances of several views may be created concurrently by pool workers
+bool initGLExtensions() noexcept
+{
+    static std::once_flag s_loaded;
+    std::call_once(s_loaded, [] {
+        glEGLImageTargetTexture2DOES =
+            reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+    });
+
+    return glEGLImageTargetTexture2DOES != nullptr;
+}
+
+constexpr uint32_t BYTES_PER_PIXEL = 4;
+} // namespace
+
+std::unique_ptr<PixelReadback> PixelReadback::create(EGLDisplay display, PixelsCallback callback,
+                                                     void* userData) noexcept
+{
+    if (!display || !callback || !eglBindAPI(EGL_OPENGL_ES_API))
+        return nullptr;
+
+    // No surface is ever used, so any config supporting OpenGL ES 3 fits when configless contexts are not supported
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!FrameTransport::hasEGLExtensions(display, {"EGL_KHR_no_config_context"}))
+    {
+        static constexpr const EGLint s_configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_NONE};
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, s_configAttribs, &config, 1, &numConfigs) || (numConfigs != 1))
+            return nullptr;
+    }
+
+    std::unique_ptr<PixelReadback> readback(new PixelReadback(display, callback, userData));
+
+    static constexpr const EGLint s_contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    readback->m_eglContext = eglCreateContext(display, config, EGL_NO_CONTEXT, s_contextAttribs);
+    if (!readback->m_eglContext)
+        return nullptr;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, readback->m_eglContext) || !initGLExtensions())
+        return nullptr;
+
+    return readback;
+}
+
+PixelReadback::~PixelReadback()
+{
+    if (!m_eglContext)
+        return;
+
+    if (eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        for (PackBuffer& packBuffer : m_packBuffers)
+        {
+            if (packBuffer.fence)
+                glDeleteSync(packBuffer.fence);
+
+            glDeleteBuffers(1, &packBuffer.buffer);
+        }
+
+        for (SlotFramebuffer& slotFramebuffer : m_slotFramebuffers)
+        {
+            glDeleteFramebuffers(1, &slotFramebuffer.framebuffer);
+            glDeleteTextures(1, &slotFramebuffer.texture);
+        }
+
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    eglDestroyContext(m_display, m_eglContext);
+}
+
+GLuint PixelReadback::getSlotFramebuffer(const FrameConsumer::Frame& frame) noexcept
+{
+    if (frame.slot >= m_slotFramebuffers.size())
+        m_slotFramebuffers.resize(frame.slot + 1);
+
+    SlotFramebuffer& slotFramebuffer = m_slotFramebuffers[frame.slot];
+    if (slotFramebuffer.framebuffer && (slotFramebuffer.generation == frame.slotGeneration))
+        return slotFramebuffer.framebuffer;
+
+    // New slot, or slot image replaced since the last time it was read
+    if (!slotFramebuffer.texture)
+        glGenTextures(1, &slotFramebuffer.texture);
+    if (!slotFramebuffer.framebuffer)
+        glGenFramebuffers(1, &slotFramebuffer.framebuffer);
+
+    glBindTexture(GL_TEXTURE_2D, slotFramebuffer.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, frame.image);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, slotFramebuffer.framebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, slotFramebuffer.texture, 0);
+    if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        g_warning("Frame image of slot %u cannot be read back", frame.slot);
+        slotFramebuffer.generation = 0;
+        return 0;
+    }
+
+    slotFramebuffer.generation = frame.slotGeneration;
+    return slotFramebuffer.framebuffer;
+}
+
+EGLSync PixelReadback::readFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept
+{
+    // The thread may also use other contexts, like the damage tracking one
+    if (!frame.image || !width || !height ||
+        !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        return EGL_NO_SYNC;
+    }
+
+    // The oldest copy must be delivered before reusing its buffer, the frame is skipped if it is still pending
+    PackBuffer& packBuffer = m_packBuffers[m_nextPackBuffer];
+    if (packBuffer.fence)
+    {
+        deliverPixels();
+        if (packBuffer.fence)
+        {
+            g_debug("Pixels readback of frame %" G_GUINT64_FORMAT " skipped, the previous copies are still pending",
+                    ++m_frameNumber);
+            return EGL_NO_SYNC;
+        }
+    }
+
+    if (frame.acquireSync)
+        eglWaitSync(m_display, frame.acquireSync, 0);
+
+    const GLuint framebuffer = getSlotFramebuffer(frame);
+    if (!framebuffer)
+        return EGL_NO_SYNC;
+
+    const GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * BYTES_PER_PIXEL;
+    if (!packBuffer.buffer)
+        glGenBuffers(1, &packBuffer.buffer);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer.buffer);
+    if (packBuffer.size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        packBuffer.size = size;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadPixels(0, 0, static_cast<GLsizei>(width), static_cast<GLsizei>(height), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    packBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    packBuffer.width = width;
+    packBuffer.height = height;
+    packBuffer.frameNumber = ++m_frameNumber;
+    m_nextPackBuffer = (m_nextPackBuffer + 1) % RING_SIZE;
+
+    // The frame image is not needed anymore once the copy into the pack buffer is done
+    EGLSync copyFence = eglCreateSync(m_display, EGL_SYNC_FENCE, nullptr);
+    glFlush();
+    return copyFence;
+}
+
+void PixelReadback::deliverPixels() noexcept
+{
+    if (!m_packBuffers[m_oldestPackBuffer].fence ||
+        !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        return;
+    }
+
+    while (m_packBuffers[m_oldestPackBuffer].fence)
+    {
+        if (!deliverPixels(m_packBuffers[m_oldestPackBuffer]))
+            break;
+
+        m_oldestPackBuffer = (m_oldestPackBuffer + 1) % RING_SIZE;
+    }
+}
+
+bool PixelReadback::deliverPixels(PackBuffer& packBuffer) noexcept
+{
+    const GLenum status = glClientWaitSync(packBuffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(packBuffer.fence);
+    packBuffer.fence = nullptr;
+    if (status == GL_WAIT_FAILED)
+    {
+        g_warning("Pixels readback of frame %" G_GUINT64_FORMAT " failed", packBuffer.frameNumber);
+        return true;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer.buffer);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, packBuffer.size, GL_MAP_READ_BIT);
+    if (data)
+    {
+        m_callback({data, packBuffer.width, packBuffer.height, packBuffer.width * BYTES_PER_PIXEL,
+                    packBuffer.frameNumber},
+                   m_userData);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+        g_warning("Cannot map the pixels of frame %" G_GUINT64_FORMAT, packBuffer.frameNumber);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "../common/FrameTransport.h"
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+// Copies frames into a ring of pixel pack buffers from a dedicated EGLContext, without waiting for the copies to
+// complete. The pixels of a frame are delivered once its copy fence is signaled, usually one or two frames later. The
+// readback of a frame is skipped while all the buffers of the ring are still pending, nothing is ever waited for.
+// Calls are serialized per view but may come from different threads, and no context is kept current in between:
+// each method makes the context current first.
+class PixelReadback final
+{
+  public:
+    static constexpr size_t RING_SIZE = 3;
+
+    struct Pixels
+    {
+        const void* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint64_t frameNumber;
+    };
+    using PixelsCallback = void (*)(const Pixels& pixels, void* userData);
+
+    // Creates the EGLContext used for the copies
+    static std::unique_ptr<PixelReadback> create(EGLDisplay display, PixelsCallback callback,
+                                                 void* userData) noexcept;
+
+    ~PixelReadback();
+
+    PixelReadback(PixelReadback&&) = delete;
+    PixelReadback& operator=(PixelReadback&&) = delete;
+    PixelReadback(const PixelReadback&) = delete;
+    PixelReadback& operator=(const PixelReadback&) = delete;
+
+    // Queues the copy of the frame, and returns a fence signaled once the copy is complete, so that the frame can be
+    // released right away (EGL_NO_SYNC on error or when the readback is skipped). The caller owns the returned fence.
+    // Skipped frames still get a frame number, so they can be counted from the gaps between the delivered ones.
+    EGLSync readFrame(const FrameConsumer::Frame& frame, uint32_t width, uint32_t height) noexcept;
+
+    // Delivers the pixels of the completed copies
+    void deliverPixels() noexcept;
+
+    bool hasPendingCopies() const noexcept
+    {
+        return m_packBuffers[m_oldestPackBuffer].fence != nullptr;
+    }
+
+  private:
+    PixelReadback(EGLDisplay display, PixelsCallback callback, void* userData) noexcept
+        : m_display(display), m_callback(callback), m_userData(userData)
+    {
+    }
+
+    const EGLDisplay m_display;
+    const PixelsCallback m_callback;
+    void* const m_userData;
+    EGLContext m_eglContext = EGL_NO_CONTEXT;
+
+    // Frame images are attached to framebuffers once per frame consumer slot
+    struct SlotFramebuffer
+    {
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        uint32_t generation = 0;
+    };
+    std::vector<SlotFramebuffer> m_slotFramebuffers;
+
+    struct PackBuffer
+    {
+        GLuint buffer = 0;
+        GLsizeiptr size = 0;
+        GLsync fence = nullptr;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint64_t frameNumber = 0;
+    };
+    std::array<PackBuffer, RING_SIZE> m_packBuffers;
+    size_t m_nextPackBuffer = 0;
+    size_t m_oldestPackBuffer = 0;
+    uint64_t m_frameNumber = 0;
+
+    GLuint getSlotFramebuffer(const FrameConsumer::Frame& frame) noexcept;
+    bool deliverPixels(PackBuffer& packBuffer) noexcept;
+};
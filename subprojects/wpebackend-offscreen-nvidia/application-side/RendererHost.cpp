@@ -26,6 +26,8 @@
 
 #include "RendererHost.h"
 
+#include "EGLDeviceSelector.h"
+
 wpe_renderer_host_interface* RendererHost::getWPEInterface() noexcept
 {
     static wpe_renderer_host_interface s_interface = {
@@ -46,12 +48,15 @@ wpe_renderer_host_interface* RendererHost::getWPEInterface() noexcept
 RendererHost::~RendererHost()
 {
     for (RendererHostClient* client : m_clients)
+    {
+        EGLDeviceSelector::removeLoad(client->m_deviceIndex);
         delete client;
+    }
 }
 
 RendererHostClient& RendererHost::addClient() noexcept
 {
-    m_clients.push_back(new RendererHostClient(this));
+    m_clients.push_back(new RendererHostClient(this, EGLDeviceSelector::selectDevice()));
     return *m_clients.back();
 }
 
@@ -65,6 +70,7 @@ void RendererHost::removeClient(const RendererHostClient* client) noexcept
         if (*it == client)
         {
             m_clients.erase(it);
+            EGLDeviceSelector::removeLoad(client->m_deviceIndex);
             delete client;
             break;
         }
@@ -26,7 +26,7 @@
 
 #pragma once
 
-#include "../common/ipc.h"
+#include "../common/ipc-messages.h"
 
 class RendererHost;
 
@@ -43,9 +43,13 @@ class RendererHostClient final : private IPC::MessageHandler
 
     RendererHost* m_host = nullptr;
     IPC::Channel m_ipcChannel;
+    const int32_t m_deviceIndex;
 
-    RendererHostClient(RendererHost* host) noexcept : m_host(host), m_ipcChannel(*this)
+    RendererHostClient(RendererHost* host, int32_t deviceIndex) noexcept
+        : m_host(host), m_ipcChannel(*this), m_deviceIndex(deviceIndex)
     {
+        // Queued before the WPEWebProcess is launched, so that it is received before the display creation
+        m_ipcChannel.sendMessage(IPC::EGLDeviceSelection(deviceIndex));
     }
 
     void handleMessage(IPC::Channel& channel, const IPC::Message& message) noexcept override;
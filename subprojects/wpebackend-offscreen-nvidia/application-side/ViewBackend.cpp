@@ -26,9 +26,18 @@
 
 #include "ViewBackend.h"
 
+#include "../common/EGLDisplayManager.h"
 #include "../common/ipc-messages.h"
+#include "EGLDeviceSelector.h"
 
+#include <glib-unix.h>
+
+#include <algorithm>
 #include <cassert>
+#include <limits>
+#include <utility>
+
+#include <unistd.h>
 
 wpe_view_backend_interface* ViewBackend::getWPEInterface() noexcept
 {
@@ -41,7 +50,24 @@ wpe_view_backend_interface* ViewBackend::getWPEInterface() noexcept
             return viewBackend;
         },
         // void destroy(void* data)
-        +[](void* data) { delete static_cast<ViewBackend*>(data); },
+        +[](void* data) {
+            // The destruction waits for the consumer step in progress, which cannot return while the view is
+            // destroyed from the pixels callback, it is then deferred to the main context
+            auto* viewBackend = static_cast<ViewBackend*>(data);
+            if (ConsumerThreadPool::isRunningOnCurrentThread(*viewBackend))
+            {
+                g_warning("ViewBackend destroyed from its pixels callback, the destruction is deferred");
+                viewBackend->m_wpeViewBackendDestroyed = true;
+                g_idle_add(G_SOURCE_FUNC(+[](ViewBackend* backend) -> gboolean {
+                               delete backend;
+                               return G_SOURCE_REMOVE;
+                           }),
+                           viewBackend);
+                return;
+            }
+
+            delete viewBackend;
+        },
         // void initialize(void* data)
         +[](void* data) { static_cast<ViewBackend*>(data)->init(); },
         // int get_renderer_host_fd(void* data)
@@ -59,139 +85,926 @@ void ViewBackend::init() noexcept
         return;
     }
 
-    m_eglDisplay = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
-
-    EGLint major, minor;
-    if (!m_eglDisplay || !eglInitialize(m_eglDisplay, &major, &minor))
+    // The device used by the WPEWebProcess is only known once its RendererBackendEGLTarget is initialized
+    m_eglDisplay = EGLDisplayManager::acquire(EGLDevice::DEFAULT_DEVICE);
+    if (!m_eglDisplay)
     {
         shut();
         g_critical("Cannot initialize EGL on ViewBackend side");
         return;
     }
 
-    m_idleSourceId = g_idle_add(G_SOURCE_FUNC(idleCallback), this);
+    // The activity state changed before the initialization is only given to WebKit from now on
+    wpe_view_backend_add_activity_state(m_wpeViewBackend, m_activityState);
 
-    m_consumerStream = EGLConsumerStream::createEGLStream(m_eglDisplay);
-    if (!m_consumerStream)
+    // Rung by the consumer worker each time a frame is available, frames are only delivered while the view is visible
+    m_frameHandoff = FrameHandoff::create();
+    if (!m_frameHandoff)
     {
         shut();
-        g_critical("Cannot create the consumer EGLStream on ViewBackend side");
+        g_critical("Cannot create the frame handoff on ViewBackend side");
         return;
     }
 
-    m_consumerThread = std::thread(&ViewBackend::consumerThreadFunc, this);
-    wpe_view_backend_dispatch_set_size(m_wpeViewBackend, m_viewParams.width, m_viewParams.height);
+    if (m_visible)
+        addFrameSource();
+
+    // The frame consumer is created once the frame transport has been negotiated with the RendererBackendEGLTarget
+    // The frame metadata ring is optional, frames are still delivered without it
+    m_frameMetadataRing = FrameMetadataRing::create();
+    if (m_frameMetadataRing)
+    {
+        m_doorbellSourceId = g_unix_fd_add(m_frameMetadataRing->getDoorbellFD(), G_IO_IN,
+                                           reinterpret_cast<GUnixFDSourceFunc>(doorbellCallback), this);
+    }
+    else
+        g_warning("Cannot create the frame metadata ring on ViewBackend side");
+
+    ConsumerThreadPool::getInstance().addClient(*this);
+    m_consumerStarted = true;
+    wpe_view_backend_dispatch_set_size(m_wpeViewBackend, m_width, m_height);
 }
 
 void ViewBackend::shut() noexcept
 {
-    if (m_idleSourceId)
+    removeFrameSource();
+
+    if (m_frameDisplayedSourceId)
     {
-        g_source_remove(m_idleSourceId);
-        m_idleSourceId = 0;
+        g_source_remove(m_frameDisplayedSourceId);
+        m_frameDisplayedSourceId = 0;
     }
 
-    if (m_consumerThread.joinable())
+    stopConsumer();
+    m_stopConsumer = false;
+    m_consumerStopped = false;
+    m_streamConnected = false;
+    m_fetchNextFrame = false;
+    m_announcedFrameId = 0;
+    if (EGLSync releaseSync = m_releaseSync.exchange(EGL_NO_SYNC))
+        eglDestroySync(m_eglDisplay, releaseSync);
+
+    m_frameHandoff.reset();
+    m_dmaBufConsumer = nullptr;
+    m_pendingFrameConsumer.reset();
+    m_frameConsumer.reset();
+
+    if (m_frameMetadataWaitSourceId)
     {
-        m_stopConsumer = true;
+        g_source_remove(m_frameMetadataWaitSourceId);
+        m_frameMetadataWaitSourceId = 0;
+    }
+    m_frameMetadataWaitedFrameId = 0;
 
-        std::unique_lock<std::mutex> lock(m_consumerMutex);
-        m_fetchNextFrame = true;
-        lock.unlock();
-        m_consumerCondition.notify_all();
+    if (m_doorbellSourceId)
+    {
+        g_source_remove(m_doorbellSourceId);
+        m_doorbellSourceId = 0;
+    }
+    m_frameMetadataRing.reset();
+    m_lastFrameMetadata = {};
+    m_lastDeliveredFrameId = 0;
+
+    EGLDisplayManager::release(m_eglDisplay.exchange(EGL_NO_DISPLAY));
+    EGLDeviceSelector::removeLoad(m_eglDevice.exchange(EGLDevice::DEFAULT_DEVICE));
+}
+
+void ViewBackend::stopConsumer() noexcept
+{
+    if (!m_consumerStarted)
+        return;
+
+    // The last step runs from a worker, which releases the per-view resources owning EGLContexts
+    auto& pool = ConsumerThreadPool::getInstance();
+    std::unique_lock<std::mutex> lock(m_consumerMutex);
+    m_stopConsumer = true;
+    lock.unlock();
+    pool.signal(*this);
+
+    lock.lock();
+    m_consumerCondition.wait(lock, [this] { return m_consumerStopped; });
+    lock.unlock();
 
-        m_consumerThread.join();
+    pool.removeClient(*this);
+    m_consumerStarted = false;
+}
+
+void ViewBackend::setIPCContext(GMainContext* context) noexcept
+{
+    if (m_eglDisplay)
+    {
+        g_warning("The IPC context must be set before the ViewBackend initialization");
+        return;
     }
-    m_stopConsumer = false;
-    m_fetchNextFrame = false;
 
-    m_availableFrame = EGL_NO_IMAGE;
-    m_consumerStream.reset();
+    // Only the IPC messages are dispatched from this context, frames are still delivered from the default one
+    if (!m_ipcChannel.setMainContext(context))
+        g_critical("Cannot attach the ViewBackend IPC channel to the given context");
+}
 
+void ViewBackend::setPresentationMode(wpe_offscreen_nvidia_presentation_mode mode, uint32_t fifoDepth) noexcept
+{
     if (m_eglDisplay)
     {
-        eglTerminate(m_eglDisplay);
-        m_eglDisplay = EGL_NO_DISPLAY;
+        g_warning("The presentation mode must be set before the ViewBackend initialization");
+        return;
+    }
+
+    switch (mode)
+    {
+    case WPE_OFFSCREEN_NVIDIA_PRESENTATION_MODE_MAILBOX:
+        m_fifoLength = EGLConsumerStream::MAILBOX_FIFO_LENGTH;
+        break;
+
+    case WPE_OFFSCREEN_NVIDIA_PRESENTATION_MODE_FIFO:
+        if ((fifoDepth == 0) || (fifoDepth > static_cast<uint32_t>(std::numeric_limits<EGLint>::max())))
+        {
+            g_warning("Invalid FIFO depth %u, keeping the current presentation mode", fifoDepth);
+            return;
+        }
+        m_fifoLength = static_cast<EGLint>(fifoDepth);
+        break;
+
+    default:
+        g_warning("Unknown presentation mode %d", static_cast<int>(mode));
+        break;
     }
 }
 
-void ViewBackend::frameComplete() noexcept
+void ViewBackend::setPixelsCallback(wpe_offscreen_nvidia_on_frame_pixels_available_callback callback,
+                                    void* userData) noexcept
 {
+    if (m_eglDisplay)
+    {
+        g_warning("The pixels callback must be set before the ViewBackend initialization");
+        return;
+    }
+
+    m_pixelsCallback = callback;
+    m_pixelsUserData = userData;
+}
+
+void ViewBackend::setDamageTracking(bool enabled) noexcept
+{
+    if (m_eglDisplay)
+    {
+        g_warning("The damage tracking must be enabled before the ViewBackend initialization");
+        return;
+    }
+
+    // The damage is only given to the frame info callback
+    if (enabled && !m_viewParams.onFrameInfoAvailableCB)
+    {
+        g_warning("The damage tracking needs a view backend created with a frame info callback");
+        return;
+    }
+
+    m_damageTracking = enabled;
+}
+
+void ViewBackend::setSkipUnchangedFrames(bool enabled) noexcept
+{
+    if (m_eglDisplay)
+    {
+        g_warning("Unchanged frames skipping must be enabled before the ViewBackend initialization");
+        return;
+    }
+
+    m_skipUnchangedFrames = enabled;
+}
+
+void ViewBackend::setActivityState(uint32_t state, bool enabled) noexcept
+{
+    if (enabled)
+        m_activityState |= state;
+    else
+        m_activityState &= ~state;
+
+    if (m_eglDisplay)
+    {
+        if (enabled)
+            wpe_view_backend_add_activity_state(m_wpeViewBackend, state);
+        else
+            wpe_view_backend_remove_activity_state(m_wpeViewBackend, state);
+    }
+
+    if (!(state & wpe_view_activity_state_visible) || (m_visible == enabled))
+        return;
+
+    // WebKit stops compositing hidden views, the frame delivery and the frame consumer are also put to sleep
     std::unique_lock<std::mutex> lock(m_consumerMutex);
-    m_fetchNextFrame = true;
+    m_visible = enabled;
     lock.unlock();
-    m_consumerCondition.notify_all();
+    ConsumerThreadPool::getInstance().signal(*this);
+
+    if (!m_eglDisplay)
+        return;
+
+    // A frame already available is delivered once the view is visible again, as the eventfd stays readable
+    if (enabled)
+        addFrameSource();
+    else
+        removeFrameSource();
+}
+
+void ViewBackend::setSizeBuckets(const wpe_offscreen_nvidia_size* sizes, uint32_t count) noexcept
+{
+    if (m_eglDisplay)
+    {
+        g_warning("The size buckets must be set before the ViewBackend initialization");
+        return;
+    }
+
+    if (!sizes)
+        count = 0;
+
+    if (count > IPC::SurfaceSizeBuckets::MAX_BUCKET_COUNT)
+    {
+        g_warning("Only %u size buckets are supported, the %u last ones are ignored",
+                  IPC::SurfaceSizeBuckets::MAX_BUCKET_COUNT, count - IPC::SurfaceSizeBuckets::MAX_BUCKET_COUNT);
+        count = IPC::SurfaceSizeBuckets::MAX_BUCKET_COUNT;
+    }
+
+    m_sizeBuckets.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if ((sizes[i].width == 0) || (sizes[i].height == 0) ||
+            (sizes[i].width > std::numeric_limits<uint16_t>::max()) ||
+            (sizes[i].height > std::numeric_limits<uint16_t>::max()))
+        {
+            g_warning("Invalid size bucket %ux%u ignored", sizes[i].width, sizes[i].height);
+            continue;
+        }
+
+        m_sizeBuckets.push_back({static_cast<uint16_t>(sizes[i].width), static_cast<uint16_t>(sizes[i].height)});
+    }
+}
+
+void ViewBackend::resize(uint32_t width, uint32_t height) noexcept
+{
+    if ((width == 0) || (height == 0))
+    {
+        g_warning("Invalid view size %ux%u", width, height);
+        return;
+    }
 
-    wpe_view_backend_dispatch_frame_displayed(m_wpeViewBackend);
+    m_width = width;
+    m_height = height;
+
+    // The RendererBackendEGLTarget is notified by WPE, and renegotiates its surface over the IPC channel if needed
+    if (m_eglDisplay)
+        wpe_view_backend_dispatch_set_size(m_wpeViewBackend, width, height);
+}
+
+void ViewBackend::frameComplete(EGLSync releaseSync) noexcept
+{
+    // Frame completed twice without being released in between, only the latest fence matters
+    if (EGLSync previousReleaseSync = m_releaseSync.exchange(releaseSync))
+        eglDestroySync(m_eglDisplay, previousReleaseSync);
+
+    // Published after the fence, which the consumer worker takes once it sees the flag
+    m_fetchNextFrame.store(true, std::memory_order_release);
+    ConsumerThreadPool::getInstance().signal(*this);
+
+    // The frame is given back to the producer right away, only WebKit is paced to the target frame rate
+    if (m_frameDisplayedSourceId)
+        return;
+
+    const int64_t delay = m_framePacer.getFrameDelay();
+    if (delay > 0)
+    {
+        const guint delayMs = static_cast<guint>((delay + 999) / 1000);
+        m_frameDisplayedSourceId = g_timeout_add(delayMs, G_SOURCE_FUNC(frameDisplayedCallback), this);
+    }
+    else
+        dispatchFrameDisplayed();
+}
+
+gboolean ViewBackend::frameDisplayedCallback(ViewBackend* backend) noexcept
+{
+    backend->m_frameDisplayedSourceId = 0;
+    backend->dispatchFrameDisplayed();
+    return G_SOURCE_REMOVE;
+}
+
+void ViewBackend::dispatchFrameDisplayed() noexcept
+{
+    m_framePacer.frameDisplayed();
+    if (!m_wpeViewBackendDestroyed)
+        wpe_view_backend_dispatch_frame_displayed(m_wpeViewBackend);
+}
+
+void ViewBackend::setTargetFPS(uint32_t fps) noexcept
+{
+    m_framePacer.setTargetFPS(fps);
+
+    // The new rate applies from the next frame, a pending notification is dispatched right away
+    if (m_frameDisplayedSourceId)
+    {
+        g_source_remove(m_frameDisplayedSourceId);
+        m_frameDisplayedSourceId = 0;
+        dispatchFrameDisplayed();
+    }
 }
 
 void ViewBackend::handleMessage(IPC::Channel& /*channel*/, const IPC::Message& message) noexcept
 {
     // Messages received on application process side from RendererBackendEGLTarget on WPEWebProcess side
-    switch (message.getCode())
+    if (!IPC::ViewBackendMessages::dispatch(*this, message))
+        g_debug("Unknown IPC message %u received on ViewBackend side", message.getCode());
+}
+
+void ViewBackend::handle(const IPC::ProtocolHandshake& message) noexcept
+{
+    // Peers which don't send the handshake (older versions) are considered as supporting no capability
+    m_protocolVersion = std::min(message.getVersion(), IPC::ProtocolHandshake::PROTOCOL_VERSION);
+    const uint32_t capabilities = message.getCapabilities() & IPC::ProtocolHandshake::SUPPORTED_CAPABILITIES;
+
+    // Only the selected frame transport is sent back
+    const uint32_t transport =
+        FrameTransport::selectTransport(EGLDisplayManager::getSupportedConsumerTransports(m_eglDisplay), capabilities);
+    if (!transport)
     {
-    case IPC::EGLStreamState::MESSAGE_CODE:
-        switch (static_cast<const IPC::EGLStreamState&>(message).getState())
-        {
-        case IPC::EGLStreamState::State::WaitingForFd:
-            if (m_consumerStream)
-            {
-                int fd = m_consumerStream->getStreamFD();
-                if (fd != -1)
-                {
-                    m_ipcChannel.sendMessage(IPC::EGLStreamFileDescriptor(fd));
-                    m_consumerStream->closeStreamFD();
-                    return;
-                }
-            }
-            g_critical("EGLStream doesn't exist on ViewBackend side");
-            break;
+        // Answering without any transport would make the peer fall back to EGLStreams, the view cannot get any frame
+        g_critical("No frame transport supported by both the ViewBackend and the RendererBackendEGLTarget");
+        m_ipcChannel.closeChannel();
+        return;
+    }
 
-        case IPC::EGLStreamState::State::Connected:
-            g_info("EGLStream successfully connected");
-            break;
+    m_capabilities = (capabilities & ~IPC::ProtocolHandshake::TRANSPORT_CAPABILITIES) | transport;
+    if (!FrameTransport::hasNativeFenceSync(m_eglDisplay))
+        m_capabilities &= ~IPC::ProtocolHandshake::DMABufReleaseFence;
 
-        case IPC::EGLStreamState::State::Error:
-            g_critical("Error on EGLStream");
-            break;
-        }
+    // Sent before the answer, so that the ring is available whatever the frame transport
+    if ((m_capabilities & IPC::ProtocolHandshake::FrameMetadataRing) && m_frameMetadataRing &&
+        (m_frameMetadataRing->getMemoryFD() != -1))
+    {
+        m_ipcChannel.sendMessage(IPC::FrameMetadataRingFileDescriptors(m_frameMetadataRing->getMemoryFD(),
+                                                                       m_frameMetadataRing->getDoorbellFD()));
+        m_frameMetadataRing->closeMemoryFD();
+    }
+
+    // Sent before the answer, so that the first surface can already be allocated in a bucket
+    if ((m_capabilities & IPC::ProtocolHandshake::LiveResize) && !m_sizeBuckets.empty())
+    {
+        m_ipcChannel.sendMessage(
+            IPC::SurfaceSizeBuckets(m_sizeBuckets.data(), static_cast<uint16_t>(m_sizeBuckets.size())));
+    }
+
+    m_ipcChannel.sendMessage(IPC::ProtocolHandshake(m_protocolVersion, m_capabilities));
+}
+
+void ViewBackend::handle(const IPC::EGLStreamState& message) noexcept
+{
+    switch (message.getState())
+    {
+    case IPC::EGLStreamState::State::WaitingForFd:
+        createFrameConsumer();
         break;
 
-    default:
+    case IPC::EGLStreamState::State::Connected: {
+        g_info("EGLStream successfully connected");
+
+        // The frame consumer only starts waiting for frames from now on
+        std::unique_lock<std::mutex> lock(m_consumerMutex);
+        m_streamConnected = true;
+        lock.unlock();
+        ConsumerThreadPool::getInstance().signal(*this);
         break;
     }
+
+    case IPC::EGLStreamState::State::Error:
+        g_critical("Error on EGLStream");
+        break;
+    }
+}
+
+void ViewBackend::handle(const IPC::DMABufBuffer& message) noexcept
+{
+    if (m_dmaBufConsumer)
+        m_dmaBufConsumer->importBuffer(message);
+    else
+        close(message.getFD());
+}
+
+void ViewBackend::handle(const IPC::DMABufFrame& message) noexcept
+{
+    if (m_dmaBufConsumer)
+    {
+        m_dmaBufConsumer->frameReady(message.getIndex(), message.getGeneration(), message.getFrameId());
+        ConsumerThreadPool::getInstance().signal(*this);
+    }
+}
+
+void ViewBackend::handle(const IPC::EGLStreamFrame& message) noexcept
+{
+    // Frame identifiers only grow, even across stream renegotiations
+    uint64_t announcedFrameId = m_announcedFrameId;
+    while ((message.getFrameId() > announcedFrameId) &&
+           !m_announcedFrameId.compare_exchange_weak(announcedFrameId, message.getFrameId()))
+        continue;
+
+    ConsumerThreadPool::getInstance().signal(*this);
+}
+
+void ViewBackend::handle(const IPC::EGLDeviceSelection& message) noexcept
+{
+    // Received before the handshake, the frames must be consumed on the device rendering them
+    const int32_t device = message.getIndex();
+    if (!m_eglDisplay || (device == m_eglDevice))
+        return;
+
+    if (m_frameConsumer)
+    {
+        g_warning("EGL device cannot be changed once frames are consumed on ViewBackend side");
+        return;
+    }
+
+    EGLDisplay display = EGLDisplayManager::acquire(device);
+    if (!display)
+    {
+        g_critical("Cannot initialize EGL on device %d on ViewBackend side, the default display is kept", device);
+        return;
+    }
+
+    EGLDisplayManager::release(m_eglDisplay.exchange(display));
+    EGLDeviceSelector::removeLoad(m_eglDevice.exchange(device));
+    EGLDeviceSelector::addLoad(device);
+}
+
+void ViewBackend::createFrameConsumer() noexcept
+{
+    if (!m_eglDisplay)
+    {
+        g_critical("Frame consumer cannot be created on ViewBackend side");
+        return;
+    }
+
+    // Peers which don't advertise any transport only support EGLStreams
+    std::unique_ptr<FrameConsumer> frameConsumer;
+    if (m_capabilities & IPC::ProtocolHandshake::DMABufTransport)
+    {
+        // DMA-BUF buffers are reallocated in place on resize, a single consumer is needed
+        if (m_dmaBufConsumer)
+            return;
+
+        auto consumer = DMABufFrameConsumer::create(m_eglDisplay, m_ipcChannel, m_fifoLength,
+                                                    m_capabilities & IPC::ProtocolHandshake::DMABufReleaseFence);
+        if (!consumer)
+        {
+            g_critical("Cannot create the DMA-BUF frame consumer on ViewBackend side");
+            return;
+        }
+
+        m_dmaBufConsumer = consumer.get();
+        frameConsumer = std::move(consumer);
+    }
+    else
+    {
+        // Only the frame info callback gives the acquire sync to the application, which must then wait for it
+        auto consumerStream = EGLConsumerStream::createEGLStream(m_eglDisplay, m_fifoLength,
+                                                                 m_viewParams.onFrameInfoAvailableCB != nullptr);
+        if (!consumerStream)
+        {
+            g_critical("Cannot create the consumer EGLStream on ViewBackend side");
+            return;
+        }
+
+        m_ipcChannel.sendMessage(IPC::EGLStreamFileDescriptor(consumerStream->getStreamFD()));
+        consumerStream->closeStreamFD();
+        frameConsumer = std::move(consumerStream);
+    }
+
+    // A new producer surface is negotiated on resize, the consumer worker switches to the new stream once connected
+    std::unique_lock<std::mutex> lock(m_consumerMutex);
+    if (m_frameConsumer)
+    {
+        m_pendingFrameConsumer = std::move(frameConsumer);
+        m_streamConnected = false;
+    }
+    else
+        m_frameConsumer = std::move(frameConsumer);
 }
 
-gboolean ViewBackend::idleCallback(ViewBackend* backend) noexcept
+void ViewBackend::addFrameSource() noexcept
 {
-    EGLImage frame = backend->m_availableFrame.exchange(EGL_NO_IMAGE);
+    // Added back once the metadata wait is over
+    if (!m_frameSourceId && m_frameHandoff && !m_frameMetadataWaitSourceId)
+    {
+        m_frameSourceId = g_unix_fd_add(m_frameHandoff->getFD(), G_IO_IN,
+                                        reinterpret_cast<GUnixFDSourceFunc>(frameAvailableCallback), this);
+    }
+}
+
+void ViewBackend::removeFrameSource() noexcept
+{
+    if (m_frameSourceId)
+    {
+        g_source_remove(m_frameSourceId);
+        m_frameSourceId = 0;
+    }
+}
+
+gboolean ViewBackend::frameAvailableCallback(gint /*fd*/, GIOCondition /*condition*/, ViewBackend* backend) noexcept
+{
+    // The eventfd stays readable while the frame is kept in the slot, until its metadata arrive or the wait times out
+    if (backend->m_frameHandoff->peek())
+    {
+        const uint64_t availableFrameId = backend->m_availableFrameInfo.frameId;
+        if (!backend->readFrameMetadata(availableFrameId) && backend->waitForFrameMetadata(availableFrameId))
+        {
+            backend->m_frameSourceId = 0;
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    EGLImage frame = backend->m_frameHandoff->take();
     if (frame)
     {
-        if (backend->m_viewParams.onFrameAvailableCB)
+        const auto& frameInfo = backend->m_availableFrameInfo;
+        backend->readFrameMetadata(frameInfo.frameId);
+
+        // Without identifier from the frame transport, the latest metadata received are the best approximation
+        const FrameMetadata& metadata = backend->m_lastFrameMetadata;
+        const uint64_t frameId = frameInfo.frameId ? frameInfo.frameId : metadata.frameId;
+        const int64_t renderedTime = (metadata.frameId == frameId) ? metadata.renderedTime : 0;
+
+        // Frames skipped by the transport (mailbox mode) are the gaps in the identifiers, minus the unchanged ones
+        const uint32_t skippedFrames = backend->m_availableFrameSkipped;
+        uint32_t droppedFrames = 0;
+        const uint64_t lastFrameId = backend->m_lastDeliveredFrameId;
+        if (frameId && lastFrameId && (frameId > lastFrameId + skippedFrames))
+        {
+            droppedFrames = static_cast<uint32_t>(
+                std::min<uint64_t>(frameId - lastFrameId - skippedFrames - 1, std::numeric_limits<uint32_t>::max()));
+        }
+        if (frameId)
+            backend->m_lastDeliveredFrameId = frameId;
+
+        if (backend->m_viewParams.onFrameInfoAvailableCB)
+        {
+            // The consumer worker may overwrite the damage as soon as the frame is completed, which the application can
+            // do from the callback, so a copy is given. An unchanged frame has an empty damage, which must not be
+            // mistaken for an unknown one.
+            static const wpe_offscreen_nvidia_rect s_noDamage = {};
+            auto& damage = backend->m_deliveredFrameDamage;
+            damage = backend->m_availableFrameDamage;
+            const wpe_offscreen_nvidia_rect* damageRects = nullptr;
+            if (backend->m_damageTracking)
+                damageRects = damage.empty() ? &s_noDamage : damage.data();
+
+            const wpe_offscreen_nvidia_frame_info info = {
+                frame, frameInfo.slot, frameInfo.slotGeneration, frameInfo.acquireSync, backend->m_availableFrameWidth,
+                backend->m_availableFrameHeight, frameId, renderedTime, backend->m_availableFrameAcquireTime,
+                droppedFrames, damageRects, static_cast<uint32_t>(damage.size()), skippedFrames};
+            backend->m_viewParams.onFrameInfoAvailableCB(backend, &info, backend->m_viewParams.userData);
+        }
+        else if (backend->m_viewParams.onFrameAvailableCB)
             backend->m_viewParams.onFrameAvailableCB(backend, frame, backend->m_viewParams.userData);
         else
             backend->frameComplete();
     }
+    else if (backend->m_frameHandoff->takeNotification())
+    {
+        // Frame already given back by the consumer worker, the notifications received in between are coalesced
+        backend->frameComplete();
+    }
 
     return G_SOURCE_CONTINUE;
 }
 
-void ViewBackend::consumerThreadFunc() noexcept
+gboolean ViewBackend::doorbellCallback(gint /*fd*/, GIOCondition /*condition*/, ViewBackend* backend) noexcept
 {
-    assert(m_consumerStream);
+    // Only rung when the doorbell was armed by a metadata wait, which may have timed out in between
+    backend->m_frameMetadataRing->clearDoorbell();
+    if (backend->m_frameMetadataWaitSourceId)
+    {
+        backend->stopFrameMetadataWait();
+        if (backend->m_visible)
+            backend->addFrameSource();
+    }
+
+    return G_SOURCE_CONTINUE;
+}
 
-    while (!m_stopConsumer)
+gboolean ViewBackend::frameMetadataTimeoutCallback(ViewBackend* backend) noexcept
+{
+    // The metadata may have been lost when the ring was full, the frame is delivered without them
+    backend->m_frameMetadataWaitSourceId = 0;
+    backend->m_frameMetadataRing->disarmDoorbell();
+    if (backend->m_visible)
+        backend->addFrameSource();
+
+    return G_SOURCE_REMOVE;
+}
+
+bool ViewBackend::readFrameMetadata(uint64_t frameId) noexcept
+{
+    if (!m_frameMetadataRing)
+        return true;
+
+    // Entries are popped in order up to the one of the given frame, or all of them if the frame identifier is unknown.
+    // In the steady state, the metadata are pushed before the frame is available, and are read here without any
+    // system call.
+    bool found = frameId && (m_lastFrameMetadata.frameId >= frameId);
+    FrameMetadata metadata;
+    while (((frameId == 0) || !found) && m_frameMetadataRing->pop(metadata))
     {
-        EGLImage frame = m_consumerStream->acquireFrame();
-        if (!frame)
-            continue;
+        m_lastFrameMetadata = metadata;
+        found = (metadata.frameId >= frameId);
+    }
 
-        m_availableFrame = frame;
+    return found || (frameId == 0);
+}
 
-        std::unique_lock<std::mutex> lock(m_consumerMutex);
-        m_consumerCondition.wait(lock, [this] { return m_fetchNextFrame; });
-        m_fetchNextFrame = false;
+bool ViewBackend::waitForFrameMetadata(uint64_t frameId) noexcept
+{
+    // Nothing is awaited without frame identifier or before the producer pushed its first metadata, and a frame is
+    // only awaited once
+    if (!m_frameMetadataRing || !frameId || !m_lastFrameMetadata.frameId || (frameId == m_frameMetadataWaitedFrameId))
+        return false;
+
+    // The doorbell is only armed while the ring is empty, entries pushed in between are read first
+    while (!m_frameMetadataRing->armDoorbell())
+    {
+        if (readFrameMetadata(frameId))
+            return false;
+    }
+
+    m_frameMetadataWaitedFrameId = frameId;
+    m_frameMetadataWaitSourceId =
+        g_timeout_add(FRAME_METADATA_MAX_WAIT_MSEC, G_SOURCE_FUNC(frameMetadataTimeoutCallback), this);
+    return true;
+}
+
+void ViewBackend::stopFrameMetadataWait() noexcept
+{
+    if (m_frameMetadataWaitSourceId)
+    {
+        g_source_remove(m_frameMetadataWaitSourceId);
+        m_frameMetadataWaitSourceId = 0;
+    }
+
+    m_frameMetadataRing->disarmDoorbell();
+}
+
+ConsumerThreadPool::Client::Schedule ViewBackend::processFrameEvents() noexcept
+{
+    std::unique_lock<std::mutex> lock(m_consumerMutex);
+    const bool stopConsumer = m_stopConsumer;
+    lock.unlock();
+    if (stopConsumer)
+    {
+        // Destroyed from the worker, as their EGLContexts must never be made current on the application threads
+        m_pixelReadback.reset();
+        m_damageTracker.reset();
+        m_frameChecksum.reset();
+        if (m_copyFence)
+        {
+            eglDestroySync(m_eglDisplay, m_copyFence);
+            m_copyFence = EGL_NO_SYNC;
+        }
+        if (m_frameReleaseSync)
+        {
+            eglDestroySync(m_eglDisplay, m_frameReleaseSync);
+            m_frameReleaseSync = EGL_NO_SYNC;
+        }
+        m_frameHeld = false;
+        m_frameReleaseRequested = false;
+        m_framePending = false;
+        m_pendingFrame = {};
+        m_acquiredFrameId = 0;
+        m_skippedFrames = 0;
+
+        lock.lock();
+        m_consumerStopped = true;
+        lock.unlock();
+        m_consumerCondition.notify_all();
+        return Schedule::Wait;
+    }
+
+    // Nothing is ever waited for from the worker, the fences are polled instead
+    if (m_frameHeld)
+    {
+        if (m_fetchNextFrame.exchange(false, std::memory_order_acquire))
+        {
+            // Frame completed twice before being released, only the latest fence matters
+            if (EGLSync releaseSync = m_releaseSync.exchange(EGL_NO_SYNC))
+            {
+                if (m_frameReleaseSync)
+                    eglDestroySync(m_eglDisplay, m_frameReleaseSync);
+                m_frameReleaseSync = releaseSync;
+            }
+            m_frameReleaseRequested = true;
+        }
+
+        if (!m_frameReleaseRequested)
+            return getIdleSchedule();
+
+        // Only one fence can be given back to the producer, the frame is then released once the copy is complete
+        if (m_copyFence && m_frameReleaseSync)
+        {
+            if (eglClientWaitSync(m_eglDisplay, m_copyFence, 0, 0) == EGL_TIMEOUT_EXPIRED)
+            {
+                getIdleSchedule();
+                return Schedule::Poll;
+            }
+
+            eglDestroySync(m_eglDisplay, m_copyFence);
+            m_copyFence = EGL_NO_SYNC;
+        }
+
+        m_frameConsumer->releaseFrame(m_frameReleaseSync ? std::exchange(m_frameReleaseSync, EGL_NO_SYNC)
+                                                         : std::exchange(m_copyFence, EGL_NO_SYNC));
+        m_frameReleaseRequested = false;
+        m_frameHeld = false;
+    }
 
-        m_consumerStream->releaseFrame();
+    lock.lock();
+    if (!m_streamConnected || !m_visible)
+    {
+        lock.unlock();
+
+        // The consumer sleeps while the view is hidden, once the pending copies and releases are done
+        return getIdleSchedule();
+    }
+
+    std::unique_ptr<FrameConsumer> previousFrameConsumer;
+    if (m_pendingFrameConsumer && !m_framePending)
+        previousFrameConsumer = std::exchange(m_frameConsumer, std::move(m_pendingFrameConsumer));
+    lock.unlock();
+
+    // No frame of the previous stream is held anymore at this point
+    previousFrameConsumer.reset();
+
+    // The frame consumer is created before the connection notification, from the IPC dispatch thread
+    assert(m_frameConsumer);
+
+    if (m_pixelsCallback && !m_pixelReadback)
+    {
+        m_pixelReadback = PixelReadback::create(m_eglDisplay, pixelsCallback, this);
+        if (!m_pixelReadback)
+        {
+            g_critical("Cannot create the pixels readback on ViewBackend side");
+            m_pixelsCallback = nullptr;
+        }
     }
+
+    if (m_damageTracking && !m_damageTracker)
+    {
+        m_damageTracker = DamageTracker::create(m_eglDisplay);
+        if (!m_damageTracker)
+        {
+            g_critical("Cannot create the damage tracker on ViewBackend side");
+            m_damageTracking = false;
+        }
+    }
+
+    // Unchanged frames have an empty damage, the checksum is only needed without damage tracking
+    if (m_skipUnchangedFrames && !m_damageTracking && !m_frameChecksum)
+    {
+        m_frameChecksum = FrameChecksum::create(m_eglDisplay);
+        if (!m_frameChecksum)
+        {
+            g_critical("Cannot create the frame checksum on ViewBackend side");
+            m_skipUnchangedFrames = false;
+        }
+    }
+
+    if (!m_framePending)
+    {
+        // Read before querying the stream, so that a frame announced afterwards is never considered as acquired
+        const uint64_t announcedFrameId = m_announcedFrameId;
+        if (!m_frameConsumer->acquireFrame(m_pendingFrame, 0))
+        {
+            // Events cannot be queried anymore once the producer is gone, wait for a new stream instead of polling
+            if (m_frameConsumer->isDisconnected())
+            {
+                // The new stream may already be connected when the previous one is replaced on resize
+                lock.lock();
+                if (!m_pendingFrameConsumer)
+                {
+                    g_warning("Frame producer disconnected on ViewBackend side");
+                    m_streamConnected = false;
+                }
+                return Schedule::Continue;
+            }
+
+            const Schedule schedule = getIdleSchedule();
+            if (schedule == Schedule::Poll)
+                return Schedule::Poll;
+
+            // DMA-BUF frames and announced EGLStream frames are signaled from the IPC dispatch thread. An announced
+            // frame may not be available yet, or only after other stream events, and the streams of the peers which
+            // don't announce their frames can only be polled, less and less often while they don't render.
+            if (m_dmaBufConsumer)
+                return Schedule::Wait;
+
+            if (!(m_capabilities & IPC::ProtocolHandshake::EGLStreamFrameNotification))
+                return Schedule::Backoff;
+
+            return (announcedFrameId > m_acquiredFrameId) ? Schedule::Poll : Schedule::Wait;
+        }
+        m_pendingFrameAcquireTime = g_get_monotonic_time();
+        m_pendingFrameWidth = m_width;
+        m_pendingFrameHeight = m_height;
+        m_framePending = true;
+
+        // Without identifier from the stream, the frames announced so far are either acquired or still queued, and
+        // the queued ones are acquired once this one is completed
+        m_acquiredFrameId =
+            std::max(m_acquiredFrameId, m_pendingFrame.frameId ? m_pendingFrame.frameId : announcedFrameId);
+
+        if (m_damageTracker)
+            m_damageTracker->submitFrame(m_pendingFrame, m_pendingFrameWidth, m_pendingFrameHeight);
+        else if (m_frameChecksum)
+            m_frameChecksum->submitFrame(m_pendingFrame, m_pendingFrameWidth, m_pendingFrameHeight);
+    }
+
+    // The frame is held back until its comparison with the previous one completes on the GPU
+    const FrameChecksum::Result checksumResult =
+        m_frameChecksum ? m_frameChecksum->pollResult() : FrameChecksum::Result::Changed;
+    if ((m_damageTracker && !m_damageTracker->pollDamage()) || (checksumResult == FrameChecksum::Result::Pending))
+    {
+        if (m_pixelReadback)
+            m_pixelReadback->deliverPixels();
+        return Schedule::Poll;
+    }
+
+    const FrameConsumer::Frame frame = std::exchange(m_pendingFrame, {});
+    m_framePending = false;
+
+    // Left untouched until frameComplete, like the other frame information
+    bool unchanged = (checksumResult == FrameChecksum::Result::Unchanged);
+    if (m_damageTracker)
+    {
+        m_availableFrameDamage.clear();
+        for (const DamageTracker::Rect& rect : m_damageTracker->getDamage())
+            m_availableFrameDamage.push_back({rect.x, rect.y, rect.width, rect.height});
+
+        // The damage is only empty when the frame is identical to the previous one
+        unchanged = m_availableFrameDamage.empty();
+    }
+
+    // Unchanged frames are given back right away
+    if (m_skipUnchangedFrames && unchanged)
+    {
+        m_frameConsumer->releaseFrame();
+        if (m_skippedFrames < std::numeric_limits<uint32_t>::max())
+            ++m_skippedFrames;
+        return Schedule::Continue;
+    }
+
+    if (m_pixelReadback)
+    {
+        m_copyFence = m_pixelReadback->readFrame(frame, m_pendingFrameWidth, m_pendingFrameHeight);
+
+        // Without any frame callback, the frame is given back to the producer as soon as it is copied, and the
+        // application thread is only notified in order to complete it
+        if (!m_viewParams.onFrameAvailableCB && !m_viewParams.onFrameInfoAvailableCB)
+        {
+            m_frameConsumer->releaseFrame(std::exchange(m_copyFence, EGL_NO_SYNC));
+            m_skippedFrames = 0;
+            m_frameHandoff->notify();
+            return Schedule::Continue;
+        }
+    }
+
+    m_availableFrameInfo = frame;
+    m_availableFrameAcquireTime = m_pendingFrameAcquireTime;
+    m_availableFrameWidth = m_pendingFrameWidth;
+    m_availableFrameHeight = m_pendingFrameHeight;
+    m_availableFrameSkipped = std::exchange(m_skippedFrames, 0);
+    m_frameHeld = true;
+    m_frameHandoff->publish(frame.image);
+
+    // Run again to check whether the frame was completed in between
+    return Schedule::Continue;
+}
+
+ConsumerThreadPool::Client::Schedule ViewBackend::getIdleSchedule() noexcept
+{
+    // Completed copies are delivered, and released frames given back, as soon as their fences are signaled
+    bool pending = false;
+    if (m_pixelReadback)
+    {
+        m_pixelReadback->deliverPixels();
+        pending = m_pixelReadback->hasPendingCopies();
+    }
+
+    std::unique_lock<std::mutex> lock(m_consumerMutex);
+    FrameConsumer* frameConsumer = m_frameConsumer.get();
+    lock.unlock();
+    if (frameConsumer && frameConsumer->processPendingReleases())
+        pending = true;
+
+    return pending ? Schedule::Poll : Schedule::Wait;
+}
+
+void ViewBackend::pixelsCallback(const PixelReadback::Pixels& pixels, void* userData)
+{
+    auto* backend = static_cast<ViewBackend*>(userData);
+    const wpe_offscreen_nvidia_frame_pixels framePixels = {pixels.data, pixels.width, pixels.height, pixels.stride,
+                                                           pixels.frameNumber};
+    backend->m_pixelsCallback(backend, &framePixels, backend->m_pixelsUserData);
 }
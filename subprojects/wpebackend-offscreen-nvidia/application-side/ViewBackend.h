@@ -26,20 +26,31 @@
 
 #pragma once
 
+#include "../common/DMABufTransport.h"
+#include "../common/EGLDevice.h"
 #include "../common/EGLStream.h"
-#include "../common/ipc.h"
+#include "../common/FrameMetadataRing.h"
+#include "../common/ipc-messages.h"
 #include "../wpebackend-offscreen-nvidia.h"
+#include "ConsumerThreadPool.h"
+#include "DamageTracker.h"
+#include "FrameChecksum.h"
+#include "FrameHandoff.h"
+#include "FramePacer.h"
+#include "PixelReadback.h"
 
 #include <condition_variable>
 #include <mutex>
-#include <thread>
+#include <vector>
 
 struct wpe_offscreen_nvidia_view_backend
 {
     // Empty struct used to hide the internal implementation from the public C interface
 };
 
-class ViewBackend final : public wpe_offscreen_nvidia_view_backend, private IPC::MessageHandler
+class ViewBackend final : public wpe_offscreen_nvidia_view_backend,
+                          private IPC::MessageHandler,
+                          private ConsumerThreadPool::Client
 {
   public:
     static wpe_view_backend_interface* getWPEInterface() noexcept;
@@ -47,6 +58,7 @@ class ViewBackend final : public wpe_offscreen_nvidia_view_backend, private IPC:
     struct ViewParams
     {
         wpe_offscreen_nvidia_on_frame_available_callback onFrameAvailableCB;
+        wpe_offscreen_nvidia_on_frame_info_available_callback onFrameInfoAvailableCB;
         void* userData;
         uint32_t width;
         uint32_t height;
@@ -54,6 +66,10 @@ class ViewBackend final : public wpe_offscreen_nvidia_view_backend, private IPC:
 
     ~ViewBackend()
     {
+        // The frame consumer may send messages until it is stopped, and messages may be dispatched from another
+        // thread until the channel is closed
+        stopConsumer();
+        m_ipcChannel.closeChannel();
         shut();
     }
 
@@ -69,30 +85,148 @@ class ViewBackend final : public wpe_offscreen_nvidia_view_backend, private IPC:
 
     void init() noexcept;
     void shut() noexcept;
-    void frameComplete() noexcept;
+    void frameComplete(EGLSync releaseSync = EGL_NO_SYNC) noexcept;
+
+    EGLDisplay getEGLDisplay() const noexcept
+    {
+        return m_eglDisplay;
+    }
+
+    int32_t getEGLDevice() const noexcept
+    {
+        return m_eglDevice;
+    }
+
+    void setIPCContext(GMainContext* context) noexcept;
+    void setPresentationMode(wpe_offscreen_nvidia_presentation_mode mode, uint32_t fifoDepth) noexcept;
+    void setPixelsCallback(wpe_offscreen_nvidia_on_frame_pixels_available_callback callback, void* userData) noexcept;
+    void setDamageTracking(bool enabled) noexcept;
+    void setSkipUnchangedFrames(bool enabled) noexcept;
+    void setTargetFPS(uint32_t fps) noexcept;
+    // Combination of wpe_view_activity_state flags
+    void setActivityState(uint32_t state, bool enabled) noexcept;
+    void setSizeBuckets(const wpe_offscreen_nvidia_size* sizes, uint32_t count) noexcept;
+    void resize(uint32_t width, uint32_t height) noexcept;
 
   private:
     const ViewParams m_viewParams;
     wpe_view_backend* const m_wpeViewBackend;
+    // Set when the destruction is deferred, as the wpe_view_backend is freed right away
+    std::atomic_bool m_wpeViewBackendDestroyed = false;
     IPC::Channel m_ipcChannel;
 
     ViewBackend(const ViewParams& viewParams, wpe_view_backend* wpeViewBackend) noexcept
-        : m_viewParams(viewParams), m_wpeViewBackend(wpeViewBackend), m_ipcChannel(*this)
+        : m_viewParams(viewParams), m_wpeViewBackend(wpeViewBackend), m_ipcChannel(*this),
+          m_width(viewParams.width), m_height(viewParams.height)
     {
     }
 
-    EGLDisplay m_eglDisplay = EGL_NO_DISPLAY;
-    std::unique_ptr<EGLConsumerStream> m_consumerStream;
+    // Size of the view content, the frames may be larger when size buckets are used
+    std::atomic<uint32_t> m_width;
+    std::atomic<uint32_t> m_height;
+    std::vector<IPC::SurfaceSizeBuckets::Size> m_sizeBuckets;
+
+    // Switched to the device of the WPEWebProcess before the frame consumer creation, from the IPC dispatch thread
+    std::atomic<EGLDisplay> m_eglDisplay = EGL_NO_DISPLAY;
+    std::atomic<int32_t> m_eglDevice = EGLDevice::DEFAULT_DEVICE;
+    std::unique_ptr<FrameConsumer> m_frameConsumer;
+    DMABufFrameConsumer* m_dmaBufConsumer = nullptr;
+    // Consumer created when the producer surface is renegotiated, swapped in by the consumer worker
+    std::unique_ptr<FrameConsumer> m_pendingFrameConsumer;
+    EGLint m_fifoLength = EGLConsumerStream::DEFAULT_FIFO_LENGTH;
+    void createFrameConsumer() noexcept;
+
+    friend IPC::ViewBackendMessages;
+    uint16_t m_protocolVersion = 0;
+    uint32_t m_capabilities = 0;
     void handleMessage(IPC::Channel& channel, const IPC::Message& message) noexcept override;
+    void handle(const IPC::ProtocolHandshake& message) noexcept;
+    void handle(const IPC::EGLStreamState& message) noexcept;
+    void handle(const IPC::DMABufBuffer& message) noexcept;
+    void handle(const IPC::DMABufFrame& message) noexcept;
+    void handle(const IPC::EGLDeviceSelection& message) noexcept;
+    void handle(const IPC::EGLStreamFrame& message) noexcept;
+
+    std::unique_ptr<FrameMetadataRing> m_frameMetadataRing;
+    guint m_doorbellSourceId = 0;
+    FrameMetadata m_lastFrameMetadata;
+    static gboolean doorbellCallback(gint fd, GIOCondition condition, ViewBackend* backend) noexcept;
+    bool readFrameMetadata(uint64_t frameId) noexcept;
+    uint64_t m_lastDeliveredFrameId = 0;
+
+    // The frame delivery is suspended while the metadata of the available frame are awaited, for a bounded time
+    static constexpr guint FRAME_METADATA_MAX_WAIT_MSEC = 4;
+    guint m_frameMetadataWaitSourceId = 0;
+    uint64_t m_frameMetadataWaitedFrameId = 0;
+    static gboolean frameMetadataTimeoutCallback(ViewBackend* backend) noexcept;
+    bool waitForFrameMetadata(uint64_t frameId) noexcept;
+    void stopFrameMetadataWait() noexcept;
+
+    // Frames are handed over to the thread delivering them through a single slot, without any lock
+    std::unique_ptr<FrameHandoff> m_frameHandoff;
+    guint m_frameSourceId = 0;
+    static gboolean frameAvailableCallback(gint fd, GIOCondition condition, ViewBackend* backend) noexcept;
+    void addFrameSource() noexcept;
+    void removeFrameSource() noexcept;
 
-    static gboolean idleCallback(ViewBackend* backend) noexcept;
-    guint m_idleSourceId = 0;
-    std::atomic<EGLImage> m_availableFrame = EGL_NO_IMAGE;
+    uint32_t m_activityState =
+        wpe_view_activity_state_visible | wpe_view_activity_state_focused | wpe_view_activity_state_in_window;
 
-    std::atomic_bool m_stopConsumer = false;
-    bool m_fetchNextFrame = false;
-    std::thread m_consumerThread;
+    FramePacer m_framePacer;
+    guint m_frameDisplayedSourceId = 0;
+    static gboolean frameDisplayedCallback(ViewBackend* backend) noexcept;
+    void dispatchFrameDisplayed() noexcept;
+    // Written by the consumer worker before publishing the frame, and left untouched until frameComplete
+    FrameConsumer::Frame m_availableFrameInfo;
+    int64_t m_availableFrameAcquireTime = 0;
+    // View size when the frame was acquired, the view may have been resized since then
+    uint32_t m_availableFrameWidth = 0;
+    uint32_t m_availableFrameHeight = 0;
+    std::vector<wpe_offscreen_nvidia_rect> m_availableFrameDamage;
+    // Only accessed from the thread delivering the frames
+    std::vector<wpe_offscreen_nvidia_rect> m_deliveredFrameDamage;
+    // Unchanged frames released without being delivered since the previous available frame
+    uint32_t m_availableFrameSkipped = 0;
+
+    // Frames are consumed from the shared ConsumerThreadPool, one step at a time
+    bool m_consumerStarted = false;
+    bool m_stopConsumer = false;
+    bool m_consumerStopped = false;
+    // Mirrors the visible activity state for the consumer worker
+    std::atomic_bool m_visible = true;
+    bool m_streamConnected = false;
+    // Latest frame announced by the EGLStream producer, frames are acquired once signaled instead of polling the stream
+    std::atomic<uint64_t> m_announcedFrameId = 0;
+    // Set by frameComplete without locking, along with the optional release fence
+    std::atomic_bool m_fetchNextFrame = false;
+    std::atomic<EGLSync> m_releaseSync = EGL_NO_SYNC;
     std::mutex m_consumerMutex;
     std::condition_variable m_consumerCondition;
-    void consumerThreadFunc() noexcept;
+    Schedule processFrameEvents() noexcept override;
+    // Poll while fences are still awaited, Wait otherwise
+    Schedule getIdleSchedule() noexcept;
+    void stopConsumer() noexcept;
+
+    // Only accessed from the consumer worker
+    bool m_frameHeld = false;
+    bool m_frameReleaseRequested = false;
+    EGLSync m_frameReleaseSync = EGL_NO_SYNC;
+    // Acquired frame not published yet, while its damage is computed
+    bool m_framePending = false;
+    FrameConsumer::Frame m_pendingFrame;
+    int64_t m_pendingFrameAcquireTime = 0;
+    uint32_t m_pendingFrameWidth = 0;
+    uint32_t m_pendingFrameHeight = 0;
+    uint64_t m_acquiredFrameId = 0;
+    EGLSync m_copyFence = EGL_NO_SYNC;
+    uint32_t m_skippedFrames = 0;
+    std::unique_ptr<PixelReadback> m_pixelReadback;
+    std::unique_ptr<DamageTracker> m_damageTracker;
+    std::unique_ptr<FrameChecksum> m_frameChecksum;
+
+    wpe_offscreen_nvidia_on_frame_pixels_available_callback m_pixelsCallback = nullptr;
+    void* m_pixelsUserData = nullptr;
+    bool m_damageTracking = false;
+    bool m_skipUnchangedFrames = false;
+    static void pixelsCallback(const PixelReadback::Pixels& pixels, void* userData);
 };
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Collects the latencies of a benchmark run and prints them, along with the throughput, as a single JSON object on the
+// standard output, so that results can be compared between releases
+class BenchmarkReport final
+{
+  public:
+    BenchmarkReport(const char* name, size_t iterations) noexcept : m_name(name)
+    {
+        m_latencies.reserve(iterations);
+    }
+
+    BenchmarkReport(BenchmarkReport&&) = delete;
+    BenchmarkReport& operator=(BenchmarkReport&&) = delete;
+    BenchmarkReport(const BenchmarkReport&) = delete;
+    BenchmarkReport& operator=(const BenchmarkReport&) = delete;
+
+    // Monotonic time in nanoseconds, comparable between threads
+    static int64_t now() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void addLatency(int64_t latencyNs) noexcept
+    {
+        m_latencies.push_back(latencyNs);
+    }
+
+    // Additional benchmark-specific values, printed as is
+    void addValue(const char* key, double value) noexcept
+    {
+        char buffer[128] = {};
+        std::snprintf(buffer, sizeof(buffer), ", \"%s\": %.3f", key, value);
+        m_values += buffer;
+    }
+
+    // The throughput counts the latencies recorded over the whole duration of the run
+    void print(int64_t durationNs) noexcept
+    {
+        std::sort(m_latencies.begin(), m_latencies.end());
+        const double seconds = static_cast<double>(durationNs) / 1e9;
+        std::printf("{\"benchmark\": \"%s\", \"iterations\": %zu, \"p50_us\": %.3f, \"p99_us\": %.3f, "
+                    "\"throughput_per_sec\": %.1f%s}\n",
+                    m_name, m_latencies.size(), getPercentile(0.50), getPercentile(0.99),
+                    (seconds > 0) ? (static_cast<double>(m_latencies.size()) / seconds) : 0.0, m_values.c_str());
+        std::fflush(stdout);
+    }
+
+  private:
+    const char* const m_name;
+    std::vector<int64_t> m_latencies;
+    std::string m_values;
+
+    // Latencies must be sorted, the result is in microseconds
+    double getPercentile(double percentile) const noexcept
+    {
+        if (m_latencies.empty())
+            return 0.0;
+
+        const size_t index = std::min(static_cast<size_t>(percentile * static_cast<double>(m_latencies.size())),
+                                      m_latencies.size() - 1);
+        return static_cast<double>(m_latencies[index]) / 1e3;
+    }
+};
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../application-side/ConsumerThreadPool.h"
+#include "../application-side/ViewBackend.h"
+#include "BenchmarkReport.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <malloc.h>
+
+namespace
+{
+uint32_t getThreadCount() noexcept
+{
+    uint32_t threadCount = 0;
+    FILE* status = std::fopen("/proc/self/status", "r");
+    if (!status)
+        return 0;
+
+    char line[256] = {};
+    while (std::fgets(line, sizeof(line), status))
+    {
+        if (std::sscanf(line, "Threads: %u", &threadCount) == 1)
+            break;
+    }
+
+    std::fclose(status);
+    return threadCount;
+}
+
+size_t getAllocatedBytes() noexcept
+{
+    return mallinfo2().uordblks;
+}
+
+struct RunCounter
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t runCount = 0;
+
+    void waitFor(size_t count) noexcept
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this, count] { return runCount >= count; });
+    }
+};
+
+// Stands for the frame consumer of a view, which only runs once signaled like a view waiting for its frames
+class SignaledClient final : public ConsumerThreadPool::Client
+{
+  public:
+    explicit SignaledClient(RunCounter& counter) noexcept : m_counter(counter)
+    {
+    }
+
+    // Only called while the client is not running
+    void signal() noexcept
+    {
+        m_signalTime = BenchmarkReport::now();
+        ConsumerThreadPool::getInstance().signal(*this);
+    }
+
+    // Only read once the run has been counted
+    int64_t getLatency() const noexcept
+    {
+        return m_latency;
+    }
+
+    Schedule processFrameEvents() noexcept override
+    {
+        if (m_signalTime)
+            m_latency = BenchmarkReport::now() - m_signalTime;
+
+        std::unique_lock<std::mutex> lock(m_counter.mutex);
+        ++m_counter.runCount;
+        lock.unlock();
+        m_counter.condition.notify_one();
+        return Schedule::Wait;
+    }
+
+  private:
+    RunCounter& m_counter;
+    int64_t m_signalTime = 0;
+    int64_t m_latency = 0;
+};
+} // namespace
+
+// Reports the heap memory used per view backend, the number of consumer threads for all the views, and the latency
+// between the signal of a view consumer and its run, all the views being signaled at once
+int main(int argc, char* argv[])
+{
+    const size_t viewCount = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 128;
+    const size_t roundCount = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 200;
+    if ((viewCount == 0) || (roundCount == 0))
+    {
+        std::fprintf(stderr, "Usage: %s [VIEW_COUNT] [ROUND_COUNT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // View backends are not initialized, as it needs an EGL device: the frame consumer resources, created on demand,
+    // are not accounted
+    auto* viewInterface = ViewBackend::getWPEInterface();
+    std::vector<void*> views;
+    views.reserve(viewCount);
+    const size_t allocatedBytes = getAllocatedBytes();
+    for (size_t i = 0; i < viewCount; ++i)
+    {
+        ViewBackend::ViewParams viewParams = {nullptr, nullptr, nullptr, 1, 1};
+        views.push_back(viewInterface->create(&viewParams, nullptr));
+    }
+    const double bytesPerView = static_cast<double>(getAllocatedBytes() - allocatedBytes) / viewCount;
+
+    const uint32_t threadCount = getThreadCount();
+    auto& pool = ConsumerThreadPool::getInstance();
+    RunCounter counter;
+    std::vector<std::unique_ptr<SignaledClient>> clients;
+    for (size_t i = 0; i < viewCount; ++i)
+    {
+        clients.push_back(std::make_unique<SignaledClient>(counter));
+        pool.addClient(*clients.back());
+    }
+
+    // Clients run once when added
+    counter.waitFor(viewCount);
+    const uint32_t poolThreadCount = getThreadCount() - threadCount;
+
+    BenchmarkReport report("consumer-pool", viewCount * roundCount);
+    const int64_t startTime = BenchmarkReport::now();
+    for (size_t round = 1; round <= roundCount; ++round)
+    {
+        for (auto& client : clients)
+            client->signal();
+
+        counter.waitFor((round + 1) * viewCount);
+        for (const auto& client : clients)
+            report.addLatency(client->getLatency());
+    }
+
+    report.addValue("views", static_cast<double>(viewCount));
+    report.addValue("pool_threads", poolThreadCount);
+    report.addValue("threads_per_view", static_cast<double>(poolThreadCount) / viewCount);
+    report.addValue("bytes_per_view", bytesPerView);
+    report.addValue("view_backend_size", sizeof(ViewBackend));
+    report.print(BenchmarkReport::now() - startTime);
+
+    for (auto& client : clients)
+        pool.removeClient(*client);
+
+    for (void* view : views)
+        viewInterface->destroy(view);
+
+    return EXIT_SUCCESS;
+}
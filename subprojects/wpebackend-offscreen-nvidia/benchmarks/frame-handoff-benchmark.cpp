@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../application-side/ConsumerThreadPool.h"
+#include "../application-side/FrameHandoff.h"
+#include "BenchmarkReport.h"
+
+#include <glib-unix.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Consumes mock frames like ViewBackend does: a frame is published once the previous one has been completed by the
+// delivering thread, which signals the consumer back through the pool
+class MockFrameConsumer final : public ConsumerThreadPool::Client
+{
+  public:
+    MockFrameConsumer(FrameHandoff& frameHandoff, size_t frameCount) noexcept
+        : m_frameHandoff(frameHandoff), m_frameCount(frameCount)
+    {
+    }
+
+    // Written before the frame is published
+    int64_t getPublishTime() const noexcept
+    {
+        return m_publishTime;
+    }
+
+    void frameComplete() noexcept
+    {
+        m_frameCompleted.store(true, std::memory_order_release);
+        ConsumerThreadPool::getInstance().signal(*this);
+    }
+
+    Schedule processFrameEvents() noexcept override
+    {
+        if (m_frameHeld)
+        {
+            if (!m_frameCompleted.exchange(false, std::memory_order_acquire))
+                return Schedule::Wait;
+
+            m_frameHeld = false;
+        }
+
+        if (m_publishedCount == m_frameCount)
+            return Schedule::Wait;
+
+        // Mock frames are never dereferenced, any non-null handle will do
+        ++m_publishedCount;
+        m_publishTime = BenchmarkReport::now();
+        m_frameHeld = true;
+        m_frameHandoff.publish(reinterpret_cast<EGLImage>(m_publishedCount));
+        return Schedule::Continue;
+    }
+
+  private:
+    FrameHandoff& m_frameHandoff;
+    const size_t m_frameCount;
+    size_t m_publishedCount = 0;
+    int64_t m_publishTime = 0;
+    bool m_frameHeld = false;
+    std::atomic_bool m_frameCompleted = false;
+};
+
+struct DeliveryState
+{
+    FrameHandoff& frameHandoff;
+    MockFrameConsumer& consumer;
+    BenchmarkReport& report;
+    size_t deliveredCount;
+};
+
+gboolean frameAvailableCallback(gint /*fd*/, GIOCondition /*condition*/, gpointer userData) noexcept
+{
+    auto* state = static_cast<DeliveryState*>(userData);
+    if (state->frameHandoff.take())
+    {
+        state->report.addLatency(BenchmarkReport::now() - state->consumer.getPublishTime());
+        ++state->deliveredCount;
+        state->consumer.frameComplete();
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+} // namespace
+
+// Measures the latency between the frame publication by a consumer worker and its dispatch from the main context of
+// the delivering thread, the throughput being bound by this round trip
+int main(int argc, char* argv[])
+{
+    const size_t frameCount = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 50000;
+    if (frameCount == 0)
+    {
+        std::fprintf(stderr, "Usage: %s [FRAME_COUNT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto frameHandoff = FrameHandoff::create();
+    if (!frameHandoff)
+    {
+        std::fprintf(stderr, "Cannot create the frame handoff: %s\n", std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    BenchmarkReport report("frame-handoff", frameCount);
+    MockFrameConsumer consumer(*frameHandoff, frameCount);
+    DeliveryState state = {*frameHandoff, consumer, report, 0};
+
+    GMainContext* context = g_main_context_new();
+    GSource* source = g_unix_fd_source_new(frameHandoff->getFD(), G_IO_IN);
+    g_source_set_callback(source, G_SOURCE_FUNC(frameAvailableCallback), &state, nullptr);
+    g_source_attach(source, context);
+
+    const int64_t startTime = BenchmarkReport::now();
+    ConsumerThreadPool::getInstance().addClient(consumer);
+    while (state.deliveredCount < frameCount)
+        g_main_context_iteration(context, TRUE);
+    report.print(BenchmarkReport::now() - startTime);
+
+    ConsumerThreadPool::getInstance().removeClient(consumer);
+    g_source_destroy(source);
+    g_source_unref(source);
+    g_main_context_unref(context);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../common/ipc.h"
+#include "BenchmarkReport.h"
+
+#include <glib.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr uint32_t getTimeLow(int64_t time) noexcept
+{
+    return static_cast<uint32_t>(time & 0xFFFFFFFF);
+}
+
+constexpr uint32_t getTimeHigh(int64_t time) noexcept
+{
+    return static_cast<uint32_t>(time >> 32);
+}
+
+constexpr int64_t joinTime(uint32_t timeLow, uint32_t timeHigh) noexcept
+{
+    return static_cast<int64_t>((static_cast<uint64_t>(timeHigh) << 32) | timeLow);
+}
+
+// Not part of the protocol, the payload carries the time at which the message was sent
+class TimedMessage final : public IPC::Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 0xFFFF;
+
+    struct Payload
+    {
+        uint32_t timeLow;
+        uint32_t timeHigh;
+    };
+
+    TimedMessage(int64_t time) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {getTimeLow(time), getTimeHigh(time)};
+    }
+
+    int64_t getTime() const noexcept
+    {
+        return joinTime(getPayload<Payload>()->timeLow, getPayload<Payload>()->timeHigh);
+    }
+};
+
+// Not part of the protocol either, the file descriptors are duplicated by the kernel on reception
+class FileDescriptorsMessage final : public IPC::Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 0xFFFE;
+    static constexpr uint16_t FD_COUNT = 2;
+
+    struct Payload
+    {
+        int fds[FD_COUNT];
+        uint32_t timeLow;
+        uint32_t timeHigh;
+    };
+
+    FileDescriptorsMessage(const int (&fds)[FD_COUNT], int64_t time) : Message(MESSAGE_CODE, FD_COUNT)
+    {
+        *getPayload<Payload>() = {{fds[0], fds[1]}, getTimeLow(time), getTimeHigh(time)};
+    }
+
+    int64_t getTime() const noexcept
+    {
+        return joinTime(getPayload<Payload>()->timeLow, getPayload<Payload>()->timeHigh);
+    }
+
+    void closeFDs() const noexcept
+    {
+        for (int fd : getPayload<Payload>()->fds)
+            close(fd);
+    }
+};
+
+class ReceiverHandler final : public IPC::MessageHandler
+{
+  public:
+    explicit ReceiverHandler(BenchmarkReport& report) noexcept : m_report(report)
+    {
+    }
+
+    size_t getReceivedCount() const noexcept
+    {
+        return m_receivedCount;
+    }
+
+    void handleMessage(IPC::Channel& /*channel*/, const IPC::Message& message) noexcept override
+    {
+        const int64_t receiveTime = BenchmarkReport::now();
+        if (message.getCode() == FileDescriptorsMessage::MESSAGE_CODE)
+        {
+            const auto& fdsMessage = static_cast<const FileDescriptorsMessage&>(message);
+            fdsMessage.closeFDs();
+            m_report.addLatency(receiveTime - fdsMessage.getTime());
+        }
+        else
+            m_report.addLatency(receiveTime - static_cast<const TimedMessage&>(message).getTime());
+
+        ++m_receivedCount;
+    }
+
+  private:
+    BenchmarkReport& m_report;
+    size_t m_receivedCount = 0;
+};
+
+class NullHandler final : public IPC::MessageHandler
+{
+  public:
+    void handleMessage(IPC::Channel& /*channel*/, const IPC::Message& /*message*/) noexcept override
+    {
+    }
+};
+
+class EchoHandler final : public IPC::MessageHandler
+{
+  public:
+    void handleMessage(IPC::Channel& channel, const IPC::Message& message) noexcept override
+    {
+        channel.sendMessage(message);
+    }
+};
+
+// Messages are sent as fast as possible from another thread, and received from the main context of the calling thread.
+// With file descriptors, each message carries two of them, and the throughput is the number of messages per second.
+void runThroughput(const char* name, size_t iterations, bool passFDs) noexcept
+{
+    BenchmarkReport report(name, iterations);
+    ReceiverHandler receiverHandler(report);
+    NullHandler senderHandler;
+    GMainContext* context = g_main_context_new();
+    {
+        IPC::Channel receiver(receiverHandler);
+        receiver.setMainContext(context);
+        IPC::Channel sender(senderHandler, receiver.detachPeerFd());
+
+        const int64_t startTime = BenchmarkReport::now();
+        int pipeFDs[2] = {-1, -1};
+        if (passFDs && (pipe2(pipeFDs, O_CLOEXEC) == -1))
+        {
+            std::fprintf(stderr, "Cannot create the file descriptors to pass\n");
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::thread senderThread([&sender, &pipeFDs, iterations, passFDs] {
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                if (passFDs)
+                    sender.sendMessage(FileDescriptorsMessage(pipeFDs, BenchmarkReport::now()));
+                else
+                    sender.sendMessage(TimedMessage(BenchmarkReport::now()));
+            }
+        });
+
+        while (receiverHandler.getReceivedCount() < iterations)
+            g_main_context_iteration(context, TRUE);
+
+        report.print(BenchmarkReport::now() - startTime);
+        senderThread.join();
+
+        if (passFDs)
+        {
+            close(pipeFDs[0]);
+            close(pipeFDs[1]);
+        }
+    }
+    g_main_context_unref(context);
+}
+
+// Each message is echoed back by a peer running its own main context from another thread, and the next one is only
+// sent once the answer has been dispatched
+void runRoundTrip(size_t iterations) noexcept
+{
+    BenchmarkReport report("ipc-round-trip", iterations);
+    ReceiverHandler clientHandler(report);
+    EchoHandler echoHandler;
+    GMainContext* clientContext = g_main_context_new();
+    GMainContext* echoContext = g_main_context_new();
+    {
+        IPC::Channel client(clientHandler);
+        client.setMainContext(clientContext);
+        IPC::Channel echo(echoHandler, client.detachPeerFd());
+        echo.setMainContext(echoContext);
+
+        std::atomic_bool stopEcho = false;
+        std::thread echoThread([echoContext, &stopEcho] {
+            while (!stopEcho)
+                g_main_context_iteration(echoContext, TRUE);
+        });
+
+        const int64_t startTime = BenchmarkReport::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            client.sendMessage(TimedMessage(BenchmarkReport::now()));
+            while (clientHandler.getReceivedCount() <= i)
+                g_main_context_iteration(clientContext, TRUE);
+        }
+        report.print(BenchmarkReport::now() - startTime);
+
+        stopEcho = true;
+        g_main_context_wakeup(echoContext);
+        echoThread.join();
+    }
+    g_main_context_unref(echoContext);
+    g_main_context_unref(clientContext);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* mode = (argc > 1) ? argv[1] : "";
+    const size_t iterations = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    if (iterations == 0)
+        mode = "";
+
+    if (std::strcmp(mode, "throughput") == 0)
+        runThroughput("ipc-throughput", iterations, false);
+    else if (std::strcmp(mode, "fd-passing") == 0)
+        runThroughput("ipc-fd-passing", iterations, true);
+    else if (std::strcmp(mode, "round-trip") == 0)
+        runRoundTrip(iterations);
+    else
+    {
+        std::fprintf(stderr, "Usage: %s throughput|fd-passing|round-trip [ITERATIONS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,622 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DMABufTransport.h"
+
+#include "EGLDisplayManager.h"
+
+#include <GLES2/gl2ext.h>
+#include <glib.h>
+
+#include <chrono>
+#include <limits>
+#include <utility>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace
+{
+// From drm_fourcc.h, the buffer layout is then implied by the driver
+constexpr uint64_t DRM_FORMAT_MOD_INVALID = 0x00FFFFFFFFFFFFFFULL;
+
+PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC eglExportDMABUFImageQueryMESA = nullptr;
+PFNEGLEXPORTDMABUFIMAGEMESAPROC eglExportDMABUFImageMESA = nullptr;
+
+// Loaded once for the whole process, as the producers of several views may be created concurrently
+bool initDMABufExportExtension() noexcept
+{
+    static const bool s_loaded = [] {
+        eglExportDMABUFImageQueryMESA = reinterpret_cast<PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC>(
+            eglGetProcAddress("eglExportDMABUFImageQueryMESA"));
+        eglExportDMABUFImageMESA =
+            reinterpret_cast<PFNEGLEXPORTDMABUFIMAGEMESAPROC>(eglGetProcAddress("eglExportDMABUFImageMESA"));
+        return eglExportDMABUFImageQueryMESA && eglExportDMABUFImageMESA;
+    }();
+
+    return s_loaded;
+}
+
+PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID = nullptr;
+
+bool initNativeFenceExtension() noexcept
+{
+    static const bool s_loaded = [] {
+        eglDupNativeFenceFDANDROID =
+            reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+        return eglDupNativeFenceFDANDROID != nullptr;
+    }();
+
+    return s_loaded;
+}
+} // namespace
+
+std::unique_ptr<DMABufFrameConsumer> DMABufFrameConsumer::create(EGLDisplay display, IPC::Channel& ipcChannel,
+                                                                 EGLint fifoLength, bool releaseFences) noexcept
+{
+    if (!(EGLDisplayManager::getSupportedConsumerTransports(display) & IPC::ProtocolHandshake::DMABufTransport))
+        return nullptr;
+
+    releaseFences = releaseFences && FrameTransport::hasNativeFenceSync(display) && initNativeFenceExtension();
+    return std::unique_ptr<DMABufFrameConsumer>(
+        new DMABufFrameConsumer(display, ipcChannel, fifoLength, releaseFences));
+}
+
+DMABufFrameConsumer::~DMABufFrameConsumer()
+{
+    for (const PendingRelease& pendingRelease : m_pendingReleases)
+        eglDestroySync(m_display, pendingRelease.releaseSync);
+
+    if (m_eglContext)
+        eglDestroyContext(m_display, m_eglContext);
+
+    for (Slot& slot : m_slots)
+    {
+        if (slot.image)
+            eglDestroyImage(m_display, slot.image);
+    }
+
+    if (m_retiredImage)
+        eglDestroyImage(m_display, m_retiredImage);
+}
+
+void DMABufFrameConsumer::importBuffer(const IPC::DMABufBuffer& message) noexcept
+{
+    const uint32_t index = message.getIndex();
+    if (index >= m_slots.size())
+    {
+        g_warning("Invalid DMA-BUF buffer index %u received on consumer side", index);
+        close(message.getFD());
+        return;
+    }
+
+    EGLAttrib attribs[] = {EGL_WIDTH,
+                           message.getWidth(),
+                           EGL_HEIGHT,
+                           message.getHeight(),
+                           EGL_LINUX_DRM_FOURCC_EXT,
+                           static_cast<EGLAttrib>(message.getFourCC()),
+                           EGL_DMA_BUF_PLANE0_FD_EXT,
+                           message.getFD(),
+                           EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+                           0,
+                           EGL_DMA_BUF_PLANE0_PITCH_EXT,
+                           static_cast<EGLAttrib>(message.getStride()),
+                           EGL_NONE,
+                           EGL_NONE,
+                           EGL_NONE,
+                           EGL_NONE,
+                           EGL_NONE};
+
+    const uint64_t modifier = message.getModifier();
+    if (modifier != DRM_FORMAT_MOD_INVALID)
+    {
+        if (FrameTransport::hasEGLExtensions(m_display, {"EGL_EXT_image_dma_buf_import_modifiers"}))
+        {
+            attribs[12] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+            attribs[13] = static_cast<EGLAttrib>(modifier & 0xFFFFFFFF);
+            attribs[14] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+            attribs[15] = static_cast<EGLAttrib>(modifier >> 32);
+        }
+        else if (modifier != 0)
+            g_warning("DMA-BUF buffer with a non-linear layout cannot be imported without modifiers support");
+    }
+
+    // The EGLImage keeps its own reference on the DMA-BUF
+    EGLImage image = eglCreateImage(m_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attribs);
+    close(message.getFD());
+    if (!image)
+        g_warning("Cannot import DMA-BUF buffer %u on consumer side (EGL error 0x%x)", index, eglGetError());
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    EGLImage previousImage = m_slots[index].image;
+    m_slots[index].image = image;
+    ++m_slots[index].generation;
+
+    // Frames announced before the reallocation don't exist anymore
+    std::erase(m_readyFrames, index);
+
+    // The application may still use the previous image of the acquired slot
+    if ((index == m_acquiredIndex) && previousImage)
+    {
+        if (m_retiredImage)
+            eglDestroyImage(m_display, m_retiredImage);
+        m_retiredImage = std::exchange(previousImage, EGL_NO_IMAGE);
+    }
+    lock.unlock();
+
+    if (previousImage)
+        eglDestroyImage(m_display, previousImage);
+}
+
+void DMABufFrameConsumer::frameReady(uint32_t index, uint32_t generation, uint64_t frameId) noexcept
+{
+    if (index >= m_slots.size())
+    {
+        g_warning("Invalid DMA-BUF frame index %u received on consumer side", index);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_slots[index].generation != generation)
+        return;
+
+    // A buffer is only sent again once released, so a slot holds at most one ready frame
+    m_slots[index].frameId = frameId;
+    m_readyFrames.push_back(index);
+    lock.unlock();
+    m_frameCondition.notify_all();
+}
+
+bool DMABufFrameConsumer::acquireFrame(Frame& frame, int timeoutUsec) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_frameCondition.wait_for(lock, std::chrono::microseconds(timeoutUsec),
+                                   [this] { return !m_readyFrames.empty(); }))
+    {
+        return false;
+    }
+
+    // In mailbox mode, older frames are given back to the producer without being delivered
+    std::deque<IPC::DMABufRelease> droppedFrames;
+    if (m_mailbox)
+    {
+        while (m_readyFrames.size() > 1)
+        {
+            const uint32_t droppedIndex = m_readyFrames.front();
+            droppedFrames.emplace_back(droppedIndex, m_slots[droppedIndex].generation);
+            m_readyFrames.pop_front();
+        }
+    }
+
+    const uint32_t index = m_readyFrames.front();
+    m_readyFrames.pop_front();
+
+    const Slot slot = m_slots[index];
+    if (slot.image)
+    {
+        m_acquiredIndex = index;
+        m_acquiredGeneration = slot.generation;
+    }
+    else
+        droppedFrames.emplace_back(index, slot.generation);
+    lock.unlock();
+
+    for (const IPC::DMABufRelease& droppedFrame : droppedFrames)
+        m_ipcChannel.sendMessage(droppedFrame);
+
+    if (!slot.image)
+        return false;
+
+    frame = {slot.image, index, slot.generation, EGL_NO_SYNC, slot.frameId};
+    return true;
+}
+
+bool DMABufFrameConsumer::releaseFrame(EGLSync releaseSync) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint32_t index = std::exchange(m_acquiredIndex, IPC::DMABufBuffer::MAX_BUFFER_COUNT);
+    EGLImage retiredImage = std::exchange(m_retiredImage, EGL_NO_IMAGE);
+    lock.unlock();
+
+    if (retiredImage)
+        eglDestroyImage(m_display, retiredImage);
+
+    if (index >= m_slots.size())
+    {
+        if (releaseSync)
+            eglDestroySync(m_display, releaseSync);
+        return false;
+    }
+
+    if (!releaseSync)
+        return m_ipcChannel.sendMessage(IPC::DMABufRelease(index, m_acquiredGeneration));
+
+    // The producer waits for the native fence on the GPU before rendering into the buffer again
+    const int releaseFenceFD = m_releaseFences ? exportReleaseFence(releaseSync) : -1;
+    if (releaseFenceFD != -1)
+    {
+        eglDestroySync(m_display, releaseSync);
+        const bool result =
+            m_ipcChannel.sendMessage(IPC::DMABufReleaseFence(releaseFenceFD, index, m_acquiredGeneration));
+        close(releaseFenceFD);
+        return result;
+    }
+
+    // DMA-BUF buffers only carry implicit fences otherwise, so the release is delayed until the fence is signaled
+    m_pendingReleases.push_back({index, m_acquiredGeneration, releaseSync});
+    return true;
+}
+
+bool DMABufFrameConsumer::processPendingReleases() noexcept
+{
+    std::erase_if(m_pendingReleases, [this](const PendingRelease& pendingRelease) {
+        if (eglClientWaitSync(m_display, pendingRelease.releaseSync, 0, 0) == EGL_TIMEOUT_EXPIRED)
+            return false;
+
+        // Also given back on error, so that the producer is not starved
+        eglDestroySync(m_display, pendingRelease.releaseSync);
+        m_ipcChannel.sendMessage(IPC::DMABufRelease(pendingRelease.index, pendingRelease.generation));
+        return true;
+    });
+
+    return !m_pendingReleases.empty();
+}
+
+int DMABufFrameConsumer::exportReleaseFence(EGLSync releaseSync) noexcept
+{
+    if (!m_eglContext)
+    {
+        // Only used to insert fences, so any config fits when configless contexts are not supported
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        if (!FrameTransport::hasEGLExtensions(m_display, {"EGL_KHR_no_config_context"}))
+        {
+            static constexpr const EGLint s_configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE};
+            EGLint numConfigs = 0;
+            if (!eglChooseConfig(m_display, s_configAttribs, &config, 1, &numConfigs) || (numConfigs != 1))
+                config = EGL_NO_CONFIG_KHR;
+        }
+
+        static constexpr const EGLint s_contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 2, EGL_NONE};
+        if (eglBindAPI(EGL_OPENGL_ES_API))
+            m_eglContext = eglCreateContext(m_display, config, EGL_NO_CONTEXT, s_contextAttribs);
+
+        if (!m_eglContext)
+        {
+            g_warning("Cannot create the DMA-BUF release fences context, release fences are polled instead");
+            m_releaseFences = false;
+            return -1;
+        }
+    }
+
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext) ||
+        !eglWaitSync(m_display, releaseSync, 0))
+    {
+        return -1;
+    }
+
+    // The native fence is signaled once the commands queued before it, including the wait, are complete
+    EGLSync nativeFence = eglCreateSync(m_display, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+    if (!nativeFence)
+        return -1;
+
+    // The file descriptor only exists once the fence is flushed
+    glFlush();
+    const int releaseFenceFD = eglDupNativeFenceFDANDROID(m_display, nativeFence);
+    eglDestroySync(m_display, nativeFence);
+    return (releaseFenceFD != EGL_NO_NATIVE_FENCE_FD_ANDROID) ? releaseFenceFD : -1;
+}
+
+std::unique_ptr<DMABufFrameProducer> DMABufFrameProducer::create(EGLDisplay display, EGLContext ctx, EGLint width,
+                                                                 EGLint height, IPC::Channel& ipcChannel) noexcept
+{
+    if (!display || !ctx || (width <= 0) || (height <= 0) || (width > std::numeric_limits<uint16_t>::max()) ||
+        (height > std::numeric_limits<uint16_t>::max()) || !initDMABufExportExtension())
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<DMABufFrameProducer> producer(new DMABufFrameProducer(display, ctx, ipcChannel));
+    if (!producer->allocateBuffers(width, height))
+        return nullptr;
+
+    return producer;
+}
+
+DMABufFrameProducer::~DMABufFrameProducer()
+{
+    deleteBuffers();
+}
+
+bool DMABufFrameProducer::allocateBuffers(EGLint width, EGLint height) noexcept
+{
+    // The compositor may rely on the depth and stencil buffers, which are shared by all the frame buffers
+    glGenRenderbuffers(1, &m_depthStencilBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthStencilBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8_OES, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // Buffers still used by the consumer are not waited for, as their releases will be ignored
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (Buffer& buffer : m_buffers)
+    {
+        buffer.inUse = false;
+        if (buffer.releaseFenceFD != -1)
+            close(std::exchange(buffer.releaseFenceFD, -1));
+    }
+    lock.unlock();
+
+    m_width = width;
+    m_height = height;
+    bool result = true;
+    for (uint32_t i = 0; (i < BUFFER_COUNT) && result; ++i)
+        result = exportBuffer(i, width, height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return result;
+}
+
+void DMABufFrameProducer::deleteBuffers() noexcept
+{
+    // GL objects can only be deleted from the thread using the context, they are destroyed with it otherwise
+    const bool contextCurrent = (eglGetCurrentContext() == m_eglContext);
+    for (Buffer& buffer : m_buffers)
+    {
+        if (buffer.image)
+        {
+            eglDestroyImage(m_display, buffer.image);
+            buffer.image = EGL_NO_IMAGE;
+        }
+
+        if (contextCurrent)
+        {
+            glDeleteFramebuffers(1, &buffer.framebuffer);
+            glDeleteTextures(1, &buffer.texture);
+        }
+        buffer.framebuffer = 0;
+        buffer.texture = 0;
+    }
+
+    if (contextCurrent)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &m_depthStencilBuffer);
+    }
+    m_depthStencilBuffer = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (Buffer& buffer : m_buffers)
+    {
+        if (buffer.releaseFenceFD != -1)
+            close(std::exchange(buffer.releaseFenceFD, -1));
+    }
+}
+
+bool DMABufFrameProducer::exportBuffer(uint32_t index, EGLint width, EGLint height) noexcept
+{
+    Buffer& buffer = m_buffers[index];
+
+    glGenTextures(1, &buffer.texture);
+    glBindTexture(GL_TEXTURE_2D, buffer.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    glGenFramebuffers(1, &buffer.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, buffer.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, buffer.texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthStencilBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthStencilBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        g_critical("DMA-BUF frame buffer %u is incomplete", index);
+        return false;
+    }
+
+    buffer.image = eglCreateImage(m_display, m_eglContext, EGL_GL_TEXTURE_2D,
+                                  reinterpret_cast<EGLClientBuffer>(static_cast<uintptr_t>(buffer.texture)), nullptr);
+    if (!buffer.image)
+    {
+        g_critical("Cannot create an EGLImage for DMA-BUF frame buffer %u", index);
+        return false;
+    }
+
+    int fourcc = 0;
+    int planeCount = 0;
+    EGLuint64KHR modifier = DRM_FORMAT_MOD_INVALID;
+    if (!eglExportDMABUFImageQueryMESA(m_display, buffer.image, &fourcc, &planeCount, &modifier) ||
+        (planeCount != 1))
+    {
+        g_critical("DMA-BUF frame buffer %u cannot be exported as a single plane", index);
+        return false;
+    }
+
+    int fd = -1;
+    EGLint stride = 0;
+    EGLint offset = 0;
+    if (!eglExportDMABUFImageMESA(m_display, buffer.image, &fd, &stride, &offset) || (fd == -1))
+    {
+        g_critical("Cannot export DMA-BUF frame buffer %u", index);
+        return false;
+    }
+
+    bool sent = false;
+    if (offset == 0)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ++buffer.generation;
+        lock.unlock();
+
+        sent = m_ipcChannel.sendMessage(IPC::DMABufBuffer(fd, index, static_cast<uint32_t>(fourcc),
+                                                          static_cast<uint32_t>(stride), modifier,
+                                                          static_cast<uint16_t>(width), static_cast<uint16_t>(height)));
+    }
+    else
+        g_critical("DMA-BUF frame buffer %u is exported at a non-zero offset", index);
+
+    close(fd);
+    return sent;
+}
+
+void DMABufFrameProducer::releaseBuffer(uint32_t index, uint32_t generation, int releaseFenceFD) noexcept
+{
+    if (index >= m_buffers.size())
+    {
+        g_warning("Invalid DMA-BUF buffer index %u released on producer side", index);
+        if (releaseFenceFD != -1)
+            close(releaseFenceFD);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_buffers[index].generation != generation)
+    {
+        lock.unlock();
+        if (releaseFenceFD != -1)
+            close(releaseFenceFD);
+        return;
+    }
+
+    m_buffers[index].inUse = false;
+    if (m_buffers[index].releaseFenceFD != -1)
+        close(m_buffers[index].releaseFenceFD);
+    m_buffers[index].releaseFenceFD = releaseFenceFD;
+}
+
+void DMABufFrameProducer::resize(EGLint width, EGLint height) noexcept
+{
+    if ((width <= 0) || (height <= 0) || (width > std::numeric_limits<uint16_t>::max()) ||
+        (height > std::numeric_limits<uint16_t>::max()))
+    {
+        g_warning("Invalid DMA-BUF frame buffers size %dx%d, keeping the current one", width, height);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_requestedWidth = width;
+    m_requestedHeight = height;
+}
+
+bool DMABufFrameProducer::makeCurrent() noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const EGLint requestedWidth = std::exchange(m_requestedWidth, 0);
+    const EGLint requestedHeight = std::exchange(m_requestedHeight, 0);
+    lock.unlock();
+
+    if ((requestedWidth > 0) && (requestedHeight > 0) &&
+        ((requestedWidth != m_width) || (requestedHeight != m_height)))
+    {
+        if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+            return false;
+
+        deleteBuffers();
+        if (!allocateBuffers(requestedWidth, requestedHeight))
+        {
+            g_critical("Cannot reallocate the DMA-BUF frame buffers");
+            return false;
+        }
+    }
+
+    // The compositor thread is never blocked by a lagging consumer, the frame is dropped when all the buffers are in
+    // use, and the buffers still read by the consumer are left untouched
+    lock.lock();
+    m_currentIndex = 0;
+    while ((m_currentIndex < BUFFER_COUNT) && m_buffers[m_currentIndex].inUse)
+        ++m_currentIndex;
+    const int releaseFenceFD =
+        (m_currentIndex < BUFFER_COUNT) ? std::exchange(m_buffers[m_currentIndex].releaseFenceFD, -1) : -1;
+    lock.unlock();
+
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_eglContext))
+    {
+        if (releaseFenceFD != -1)
+            close(releaseFenceFD);
+        m_currentIndex = BUFFER_COUNT;
+        return false;
+    }
+
+    if (m_currentIndex == BUFFER_COUNT)
+    {
+        g_debug("No DMA-BUF frame buffer released by the consumer, frame dropped");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+
+    if (releaseFenceFD != -1)
+        waitForReleaseFence(releaseFenceFD);
+
+    // The compositor renders into the framebuffer bound when the frame starts
+    glBindFramebuffer(GL_FRAMEBUFFER, m_buffers[m_currentIndex].framebuffer);
+    return true;
+}
+
+void DMABufFrameProducer::waitForReleaseFence(int releaseFenceFD) noexcept
+{
+    // The rendering commands of the frame are queued after the wait, the calling thread is never blocked
+    const EGLAttrib attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, releaseFenceFD, EGL_NONE};
+    EGLSync releaseSync = eglCreateSync(m_display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+    if (releaseSync)
+    {
+        // The sync owns the file descriptor once created
+        eglWaitSync(m_display, releaseSync, 0);
+        eglDestroySync(m_display, releaseSync);
+        return;
+    }
+
+    // Native fences are file descriptors readable once signaled
+    g_warning("Cannot import the DMA-BUF release fence (EGL error 0x%x), waiting for it", eglGetError());
+    pollfd pollFD = {releaseFenceFD, POLLIN, 0};
+    poll(&pollFD, 1, RELEASE_MAX_TIMEOUT_USEC / 1000);
+    close(releaseFenceFD);
+}
+
+bool DMABufFrameProducer::swapBuffers(uint64_t frameId) noexcept
+{
+    if (m_currentIndex >= BUFFER_COUNT)
+        return false;
+
+    const uint32_t index = std::exchange(m_currentIndex, BUFFER_COUNT);
+
+    // Rendering commands must be submitted before the consumer imports the buffer, the DMA-BUF implicit fences then
+    // make it wait for their completion
+    glFlush();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_buffers[index].inUse = true;
+    lock.unlock();
+
+    // The frame is dropped rather than queued behind a lagging consumer, its buffer is then released right away
+    if (m_ipcChannel.sendMessage(IPC::DMABufFrame(index, m_buffers[index].generation, frameId),
+                                 IPC::Channel::Delivery::Droppable))
+    {
+        return true;
+    }
+
+    releaseBuffer(index, m_buffers[index].generation);
+    return false;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "FrameTransport.h"
+#include "ipc-messages.h"
+
+#include <GLES2/gl2.h>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Frame transport based on a small pool of GL textures exported as DMA-BUFs by the producer
+// (EGL_MESA_image_dma_buf_export) and imported as EGLImages by the consumer (EGL_EXT_image_dma_buf_import).
+// Buffers ownership goes back and forth through IPC messages. The rendering of the producer is synchronized by the
+// implicit fencing of the DMA-BUFs done by the kernel drivers, the release fences of the consumer are either sent as
+// native fences waited for on the GPU by the producer, or polled by the consumer before releasing the buffers.
+
+class DMABufFrameConsumer final : public FrameConsumer
+{
+  public:
+    // A FIFO length of 0 only keeps the latest frame (mailbox mode), otherwise all frames are delivered in order.
+    // Release fences are sent to the producer as native fences when it supports them (DMABufReleaseFence capability).
+    static std::unique_ptr<DMABufFrameConsumer> create(EGLDisplay display, IPC::Channel& ipcChannel, EGLint fifoLength,
+                                                       bool releaseFences) noexcept;
+
+    ~DMABufFrameConsumer() override;
+
+    // Called from the IPC dispatch thread
+    void importBuffer(const IPC::DMABufBuffer& message) noexcept;
+    void frameReady(uint32_t index, uint32_t generation, uint64_t frameId) noexcept;
+
+    bool acquireFrame(Frame& frame, int timeoutUsec) noexcept override;
+    bool releaseFrame(EGLSync releaseSync = EGL_NO_SYNC) noexcept override;
+    bool processPendingReleases() noexcept override;
+
+    bool isDisconnected() const noexcept override
+    {
+        return false;
+    }
+
+  private:
+    DMABufFrameConsumer(EGLDisplay display, IPC::Channel& ipcChannel, EGLint fifoLength, bool releaseFences) noexcept
+        : m_display(display), m_ipcChannel(ipcChannel), m_mailbox(fifoLength == 0), m_releaseFences(releaseFences)
+    {
+    }
+
+    const EGLDisplay m_display;
+    IPC::Channel& m_ipcChannel;
+    const bool m_mailbox;
+
+    struct Slot
+    {
+        EGLImage image = EGL_NO_IMAGE;
+        uint32_t generation = 0;
+        uint64_t frameId = 0;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_frameCondition;
+    std::array<Slot, IPC::DMABufBuffer::MAX_BUFFER_COUNT> m_slots;
+    std::deque<uint32_t> m_readyFrames;
+    uint32_t m_acquiredIndex = IPC::DMABufBuffer::MAX_BUFFER_COUNT;
+    uint32_t m_acquiredGeneration = 0;
+    // Image of the acquired slot replaced by a reallocation, destroyed once the frame is released
+    EGLImage m_retiredImage = EGL_NO_IMAGE;
+
+    // Only accessed from the thread releasing the frames. The context is created on first use, to insert the native
+    // fences after the release fences.
+    bool m_releaseFences;
+    EGLContext m_eglContext = EGL_NO_CONTEXT;
+    int exportReleaseFence(EGLSync releaseSync) noexcept;
+
+    struct PendingRelease
+    {
+        uint32_t index;
+        uint32_t generation;
+        EGLSync releaseSync;
+    };
+    std::vector<PendingRelease> m_pendingReleases;
+};
+
+class DMABufFrameProducer final : public FrameProducer
+{
+  public:
+    static constexpr uint32_t BUFFER_COUNT = 3;
+    static_assert(BUFFER_COUNT <= IPC::DMABufBuffer::MAX_BUFFER_COUNT, "DMA-BUF pool is too large");
+
+    // Maximum time spent waiting for a release fence which cannot be waited for on the GPU
+    static constexpr int RELEASE_MAX_TIMEOUT_USEC = 100 * 1000;
+
+    // Must be called with the given EGLContext current
+    static std::unique_ptr<DMABufFrameProducer> create(EGLDisplay display, EGLContext ctx, EGLint width, EGLint height,
+                                                       IPC::Channel& ipcChannel) noexcept;
+
+    ~DMABufFrameProducer() override;
+
+    // Called from the IPC dispatch thread. The buffer may still be read until the optional native fence file
+    // descriptor is signaled, its ownership is transferred to the producer.
+    void releaseBuffer(uint32_t index, uint32_t generation, int releaseFenceFD = -1) noexcept;
+
+    // The buffers are reallocated at the next makeCurrent call, as the EGLContext may not be current yet
+    void resize(EGLint width, EGLint height) noexcept;
+
+    bool makeCurrent() noexcept override;
+    bool swapBuffers(uint64_t frameId) noexcept override;
+
+  private:
+    DMABufFrameProducer(EGLDisplay display, EGLContext ctx, IPC::Channel& ipcChannel) noexcept
+        : m_display(display), m_eglContext(ctx), m_ipcChannel(ipcChannel)
+    {
+    }
+
+    const EGLDisplay m_display;
+    const EGLContext m_eglContext;
+    IPC::Channel& m_ipcChannel;
+
+    struct Buffer
+    {
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        EGLImage image = EGL_NO_IMAGE;
+        uint32_t generation = 0;
+        bool inUse = false;
+        int releaseFenceFD = -1;
+    };
+    std::array<Buffer, BUFFER_COUNT> m_buffers;
+    GLuint m_depthStencilBuffer = 0;
+    uint32_t m_currentIndex = BUFFER_COUNT;
+    EGLint m_width = 0;
+    EGLint m_height = 0;
+
+    std::mutex m_mutex;
+    EGLint m_requestedWidth = 0;
+    EGLint m_requestedHeight = 0;
+
+    bool allocateBuffers(EGLint width, EGLint height) noexcept;
+    void deleteBuffers() noexcept;
+    bool exportBuffer(uint32_t index, EGLint width, EGLint height) noexcept;
+    void waitForReleaseFence(int releaseFenceFD) noexcept;
+};
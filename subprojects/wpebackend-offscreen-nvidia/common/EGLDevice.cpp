@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "EGLDevice.h"
+
+#include "FrameTransport.h"
+
+#include <mutex>
+#include <vector>
+
+namespace
+{
+// Devices cannot be hotplugged, they are only enumerated once
+const std::vector<EGLDeviceEXT>& getDevices() noexcept
+{
+    static std::vector<EGLDeviceEXT> s_devices;
+    static std::once_flag s_onceFlag;
+    std::call_once(s_onceFlag, [] {
+        if (!FrameTransport::hasEGLClientExtensions({"EGL_EXT_device_enumeration", "EGL_EXT_platform_device"}))
+            return;
+
+        auto eglQueryDevicesEXT = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+        EGLint count = 0;
+        if (!eglQueryDevicesEXT || !eglQueryDevicesEXT(0, nullptr, &count) || (count <= 0))
+            return;
+
+        s_devices.resize(static_cast<size_t>(count));
+        if (!eglQueryDevicesEXT(count, s_devices.data(), &count))
+            count = 0;
+        s_devices.resize(static_cast<size_t>(count));
+    });
+
+    return s_devices;
+}
+} // namespace
+
+int32_t EGLDevice::getDeviceCount() noexcept
+{
+    return static_cast<int32_t>(getDevices().size());
+}
+
+EGLDeviceEXT EGLDevice::getDevice(int32_t index) noexcept
+{
+    const auto& devices = getDevices();
+    if ((index < 0) || (index >= static_cast<int32_t>(devices.size())))
+        return EGL_NO_DEVICE_EXT;
+
+    return devices[static_cast<size_t>(index)];
+}
+
+EGLenum EGLDevice::getPlatform(int32_t index) noexcept
+{
+    return getDevice(index) ? EGL_PLATFORM_DEVICE_EXT : EGL_PLATFORM_SURFACELESS_MESA;
+}
+
+EGLNativeDisplayType EGLDevice::getNativeDisplay(int32_t index) noexcept
+{
+    EGLDeviceEXT device = getDevice(index);
+    return device ? static_cast<EGLNativeDisplayType>(device) : EGL_DEFAULT_DISPLAY;
+}
+
+EGLDisplay EGLDevice::getPlatformDisplay(int32_t index) noexcept
+{
+    return eglGetPlatformDisplay(getPlatform(index), getNativeDisplay(index), nullptr);
+}
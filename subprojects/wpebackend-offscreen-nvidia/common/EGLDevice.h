@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+
+// EGL devices (GPUs) enumerated with EGL_EXT_device_enumeration, on which displays are created with
+// EGL_EXT_platform_device. Devices are identified by their enumeration index, which matches between the application
+// process and the WPEWebProcesses as long as they use the same EGL implementation.
+class EGLDevice final
+{
+  public:
+    EGLDevice() = delete;
+
+    // Index of the default surfaceless display, on which the EGL implementation picks the device
+    static constexpr int32_t DEFAULT_DEVICE = -1;
+
+    // Returns 0 if devices cannot be enumerated or used as displays
+    static int32_t getDeviceCount() noexcept;
+    // Returns EGL_NO_DEVICE_EXT for the default device or an invalid index
+    static EGLDeviceEXT getDevice(int32_t index) noexcept;
+
+    // Platform and native display to give to eglGetPlatformDisplay for the given device index
+    static EGLenum getPlatform(int32_t index) noexcept;
+    static EGLNativeDisplayType getNativeDisplay(int32_t index) noexcept;
+    static EGLDisplay getPlatformDisplay(int32_t index) noexcept;
+};
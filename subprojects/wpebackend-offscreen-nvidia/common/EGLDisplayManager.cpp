@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "EGLDisplayManager.h"
+
+#include "EGLDevice.h"
+#include "FrameTransport.h"
+
+#include <glib.h>
+
+#include <mutex>
+#include <vector>
+
+namespace
+{
+struct ManagedDisplay
+{
+    EGLDisplay display;
+    uint32_t refCount;
+    uint32_t consumerTransports;
+};
+
+// Displays are acquired from the main thread and from the IPC dispatch threads of the views
+std::mutex s_mutex;
+std::vector<ManagedDisplay> s_displays;
+
+ManagedDisplay* findDisplay(EGLDisplay display) noexcept
+{
+    for (ManagedDisplay& managedDisplay : s_displays)
+    {
+        if (managedDisplay.display == display)
+            return &managedDisplay;
+    }
+
+    return nullptr;
+}
+} // namespace
+
+EGLDisplay EGLDisplayManager::acquire(int32_t device) noexcept
+{
+    EGLDisplay display = EGLDevice::getPlatformDisplay(device);
+    if (!display)
+        return EGL_NO_DISPLAY;
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (ManagedDisplay* managedDisplay = findDisplay(display))
+    {
+        ++managedDisplay->refCount;
+        return display;
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(display, &major, &minor))
+        return EGL_NO_DISPLAY;
+
+    s_displays.push_back({display, 1, FrameTransport::getSupportedConsumerTransports(display)});
+    return display;
+}
+
+void EGLDisplayManager::release(EGLDisplay display) noexcept
+{
+    if (!display)
+        return;
+
+    std::unique_lock<std::mutex> lock(s_mutex);
+    for (auto it = s_displays.begin(); it != s_displays.end(); ++it)
+    {
+        if (it->display == display)
+        {
+            if (--it->refCount == 0)
+            {
+                eglTerminate(display);
+                s_displays.erase(it);
+            }
+            return;
+        }
+    }
+
+    g_warning("Releasing an EGLDisplay which was not acquired");
+}
+
+uint32_t EGLDisplayManager::getSupportedConsumerTransports(EGLDisplay display) noexcept
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+    if (const ManagedDisplay* managedDisplay = findDisplay(display))
+        return managedDisplay->consumerTransports;
+
+    lock.unlock();
+    return FrameTransport::getSupportedConsumerTransports(display);
+}
@@ -26,8 +26,26 @@
 
 #include "EGLStream.h"
 
+#include <glib.h>
+
+#include <atomic>
+
+#include <unistd.h>
+
 namespace
 {
+// Consumer streams are replaced on resize while the slot caches of the view are kept, so the generations must never be
+// reused by another stream of the process. 0 is never given, as it is used to mark invalid cache entries.
+uint32_t createSlotGeneration() noexcept
+{
+    static std::atomic<uint32_t> s_nextGeneration = 1;
+    uint32_t generation = s_nextGeneration++;
+    while (!generation)
+        generation = s_nextGeneration++;
+
+    return generation;
+}
+
 PFNEGLCREATESTREAMKHRPROC eglCreateStreamKHR = nullptr;
 PFNEGLDESTROYSTREAMKHRPROC eglDestroyStreamKHR = nullptr;
 PFNEGLGETSTREAMFILEDESCRIPTORKHRPROC eglGetStreamFileDescriptorKHR = nullptr;
@@ -38,87 +56,49 @@ PFNEGLSTREAMIMAGECONSUMERCONNECTNVPROC eglStreamImageConsumerConnectNV = nullptr
 PFNEGLSTREAMACQUIREIMAGENVPROC eglStreamAcquireImageNV = nullptr;
 PFNEGLSTREAMRELEASEIMAGENVPROC eglStreamReleaseImageNV = nullptr;
 PFNEGLQUERYSTREAMCONSUMEREVENTNVPROC eglQueryStreamConsumerEventNV = nullptr;
+PFNEGLSETSTREAMMETADATANVPROC eglSetStreamMetadataNV = nullptr;
+PFNEGLQUERYSTREAMMETADATANVPROC eglQueryStreamMetadataNV = nullptr;
 
-bool initEGLStreamsExtensions() noexcept
+template <typename Function> bool loadFunction(Function& function, const char* name) noexcept
 {
-    if (!eglCreateStreamKHR)
-    {
-        eglCreateStreamKHR = reinterpret_cast<PFNEGLCREATESTREAMKHRPROC>(eglGetProcAddress("eglCreateStreamKHR"));
-        if (!eglCreateStreamKHR)
-            return false;
-    }
-
-    if (!eglDestroyStreamKHR)
-    {
-        eglDestroyStreamKHR = reinterpret_cast<PFNEGLDESTROYSTREAMKHRPROC>(eglGetProcAddress("eglDestroyStreamKHR"));
-        if (!eglDestroyStreamKHR)
-            return false;
-    }
-
-    if (!eglGetStreamFileDescriptorKHR)
-    {
-        eglGetStreamFileDescriptorKHR =
-            reinterpret_cast<PFNEGLGETSTREAMFILEDESCRIPTORKHRPROC>(eglGetProcAddress("eglGetStreamFileDescriptorKHR"));
-        if (!eglGetStreamFileDescriptorKHR)
-            return false;
-    }
-
-    if (!eglQueryStreamKHR)
-    {
-        eglQueryStreamKHR = reinterpret_cast<PFNEGLQUERYSTREAMKHRPROC>(eglGetProcAddress("eglQueryStreamKHR"));
-        if (!eglQueryStreamKHR)
-            return false;
-    }
-
-    if (!eglCreateStreamFromFileDescriptorKHR)
-    {
-        eglCreateStreamFromFileDescriptorKHR = reinterpret_cast<PFNEGLCREATESTREAMFROMFILEDESCRIPTORKHRPROC>(
-            eglGetProcAddress("eglCreateStreamFromFileDescriptorKHR"));
-        if (!eglCreateStreamFromFileDescriptorKHR)
-            return false;
-    }
-
-    if (!eglCreateStreamProducerSurfaceKHR)
-    {
-        eglCreateStreamProducerSurfaceKHR = reinterpret_cast<PFNEGLCREATESTREAMPRODUCERSURFACEKHRPROC>(
-            eglGetProcAddress("eglCreateStreamProducerSurfaceKHR"));
-        if (!eglCreateStreamProducerSurfaceKHR)
-            return false;
-    }
-
-    if (!eglStreamImageConsumerConnectNV)
-    {
-        eglStreamImageConsumerConnectNV = reinterpret_cast<PFNEGLSTREAMIMAGECONSUMERCONNECTNVPROC>(
-            eglGetProcAddress("eglStreamImageConsumerConnectNV"));
-        if (!eglStreamImageConsumerConnectNV)
-            return false;
-    }
+    function = reinterpret_cast<Function>(eglGetProcAddress(name));
+    return function != nullptr;
+}
 
-    if (!eglStreamAcquireImageNV)
-    {
-        eglStreamAcquireImageNV =
-            reinterpret_cast<PFNEGLSTREAMACQUIREIMAGENVPROC>(eglGetProcAddress("eglStreamAcquireImageNV"));
-        if (!eglStreamAcquireImageNV)
-            return false;
-    }
+// Extension functions don't depend on the display, they are loaded once for the whole process whatever the number of
+// streams, and never written again so that streams can be created concurrently from several threads
+bool initEGLStreamsExtensions() noexcept
+{
+    static const bool s_loaded =
+        loadFunction(eglCreateStreamKHR, "eglCreateStreamKHR") &&
+        loadFunction(eglDestroyStreamKHR, "eglDestroyStreamKHR") &&
+        loadFunction(eglGetStreamFileDescriptorKHR, "eglGetStreamFileDescriptorKHR") &&
+        loadFunction(eglQueryStreamKHR, "eglQueryStreamKHR") &&
+        loadFunction(eglCreateStreamFromFileDescriptorKHR, "eglCreateStreamFromFileDescriptorKHR") &&
+        loadFunction(eglCreateStreamProducerSurfaceKHR, "eglCreateStreamProducerSurfaceKHR") &&
+        loadFunction(eglStreamImageConsumerConnectNV, "eglStreamImageConsumerConnectNV") &&
+        loadFunction(eglStreamAcquireImageNV, "eglStreamAcquireImageNV") &&
+        loadFunction(eglStreamReleaseImageNV, "eglStreamReleaseImageNV") &&
+        loadFunction(eglQueryStreamConsumerEventNV, "eglQueryStreamConsumerEventNV");
+
+    return s_loaded;
+}
 
-    if (!eglStreamReleaseImageNV)
-    {
-        eglStreamReleaseImageNV =
-            reinterpret_cast<PFNEGLSTREAMRELEASEIMAGENVPROC>(eglGetProcAddress("eglStreamReleaseImageNV"));
-        if (!eglStreamReleaseImageNV)
-            return false;
-    }
+// Reusable syncs are optional, frames are acquired without explicit synchronization when they are not supported. Like
+// the release syncs given by the consumer, they are managed with the core EGL 1.5 functions rather than the KHR ones,
+// so that a single family of sync functions is ever used on a display.
+bool hasEGLReusableSyncExtension(EGLDisplay display) noexcept
+{
+    return FrameTransport::hasEGLExtensions(display, {"EGL_KHR_reusable_sync"});
+}
 
-    if (!eglQueryStreamConsumerEventNV)
-    {
-        eglQueryStreamConsumerEventNV =
-            reinterpret_cast<PFNEGLQUERYSTREAMCONSUMEREVENTNVPROC>(eglGetProcAddress("eglQueryStreamConsumerEventNV"));
-        if (!eglQueryStreamConsumerEventNV)
-            return false;
-    }
+// Stream metadata are optional, frames are delivered without identifier when they are not supported
+bool initEGLStreamMetadataExtension(EGLDisplay display) noexcept
+{
+    static const bool s_loaded = loadFunction(eglSetStreamMetadataNV, "eglSetStreamMetadataNV") &&
+                                 loadFunction(eglQueryStreamMetadataNV, "eglQueryStreamMetadataNV");
 
-    return true;
+    return s_loaded && FrameTransport::hasEGLExtensions(display, {"EGL_NV_stream_metadata"});
 }
 } // namespace
 
@@ -137,16 +117,21 @@ EGLStream::StreamStatus EGLStream::getStatus() const noexcept
         return StreamStatus::Error;
 }
 
-std::unique_ptr<EGLConsumerStream> EGLConsumerStream::createEGLStream(EGLDisplay display) noexcept
+std::unique_ptr<EGLConsumerStream> EGLConsumerStream::createEGLStream(EGLDisplay display, EGLint fifoLength,
+                                                                     bool explicitSync) noexcept
 {
-    if (!display || !initEGLStreamsExtensions())
+    if (!display || (fifoLength < 0) || !initEGLStreamsExtensions())
         return nullptr;
 
     std::unique_ptr<EGLConsumerStream> stream(new EGLConsumerStream(display));
 
-    static constexpr const EGLint s_streamAttribs[] = {
-        EGL_STREAM_FIFO_LENGTH_KHR, 1, EGL_CONSUMER_ACQUIRE_TIMEOUT_USEC_KHR, ACQUIRE_MAX_TIMEOUT_USEC, EGL_NONE};
-    stream->m_eglStream = eglCreateStreamKHR(display, s_streamAttribs);
+    // The metadata block is allocated by the consumer, and filled by the producer for each frame
+    stream->m_hasFrameIdMetadata = initEGLStreamMetadataExtension(display);
+    const EGLint metadataAttrib = stream->m_hasFrameIdMetadata ? EGL_METADATA0_SIZE_NV : EGL_NONE;
+    const EGLint metadataSize = sizeof(uint64_t);
+    const EGLint streamAttribs[] = {EGL_STREAM_FIFO_LENGTH_KHR, fifoLength, EGL_CONSUMER_ACQUIRE_TIMEOUT_USEC_KHR,
+                                    ACQUIRE_MAX_TIMEOUT_USEC, metadataAttrib, metadataSize, EGL_NONE};
+    stream->m_eglStream = eglCreateStreamKHR(display, streamAttribs);
     if (!stream->m_eglStream)
         return nullptr;
 
@@ -157,6 +142,9 @@ std::unique_ptr<EGLConsumerStream> EGLConsumerStream::createEGLStream(EGLDisplay
     if (!eglStreamImageConsumerConnectNV(stream->m_display, stream->m_eglStream, 0, nullptr, nullptr))
         return nullptr;
 
+    if (explicitSync && hasEGLReusableSyncExtension(display))
+        stream->m_acquireSync = eglCreateSync(display, EGL_SYNC_REUSABLE_KHR, nullptr);
+
     return stream;
 }
 
@@ -165,8 +153,14 @@ EGLConsumerStream::~EGLConsumerStream()
     if (m_streamFD != -1)
         close(m_streamFD);
 
-    if (m_eglImage)
-        eglDestroyImage(m_display, m_eglImage);
+    for (Slot& slot : m_slots)
+    {
+        if (slot.image)
+            eglDestroyImage(m_display, slot.image);
+    }
+
+    if (m_acquireSync)
+        eglDestroySync(m_display, m_acquireSync);
 }
 
 void EGLConsumerStream::closeStreamFD() noexcept
@@ -178,54 +172,116 @@ void EGLConsumerStream::closeStreamFD() noexcept
     }
 }
 
-EGLImage EGLConsumerStream::acquireFrame() noexcept
+bool EGLConsumerStream::acquireFrame(Frame& frame, int timeoutUsec) noexcept
 {
     EGLenum event = 0;
     EGLAttrib data = 0;
     // WARNING: specifications state that the timeout is in nanoseconds
     // (see: https://registry.khronos.org/EGL/extensions/NV/EGL_NV_stream_consumer_eglimage.txt)
     // but in reality it is in microseconds (at least with the version 535.113.01 of the NVidia drivers)
-    if (!eglQueryStreamConsumerEventNV(m_display, m_eglStream, ACQUIRE_MAX_TIMEOUT_USEC, &event, &data))
-        return EGL_NO_IMAGE;
+    if (!eglQueryStreamConsumerEventNV(m_display, m_eglStream, timeoutUsec, &event, &data))
+        return false;
 
     switch (event)
     {
     case EGL_STREAM_IMAGE_ADD_NV:
-        if (m_eglImage)
-            eglDestroyImage(m_display, m_eglImage);
-
-        m_eglImage = eglCreateImage(m_display, EGL_NO_CONTEXT, EGL_STREAM_CONSUMER_IMAGE_NV,
-                                    static_cast<EGLClientBuffer>(m_eglStream), nullptr);
+        addImage();
         break;
 
     case EGL_STREAM_IMAGE_REMOVE_NV:
         if (data)
+            removeImage(reinterpret_cast<EGLImage>(data));
+        break;
+
+    case EGL_STREAM_IMAGE_AVAILABLE_NV: {
+        EGLImage image = EGL_NO_IMAGE;
+        if (!eglStreamAcquireImageNV(m_display, m_eglStream, &image, m_acquireSync))
+            break;
+
+        for (uint32_t i = 0; i < m_slots.size(); ++i)
         {
-            EGLImage image = reinterpret_cast<EGLImage>(data);
-            eglDestroyImage(m_display, image);
-            if (image == m_eglImage)
-                m_eglImage = EGL_NO_IMAGE;
+            if (m_slots[i].image == image)
+            {
+                m_acquiredImage = image;
+                frame = {image, i, m_slots[i].generation, m_acquireSync, 0};
+                if (m_hasFrameIdMetadata &&
+                    !eglQueryStreamMetadataNV(m_display, m_eglStream, EGL_CONSUMER_METADATA_NV, 0, 0,
+                                              sizeof(frame.frameId), &frame.frameId))
+                {
+                    frame.frameId = 0;
+                }
+                return true;
+            }
         }
-        break;
 
-    case EGL_STREAM_IMAGE_AVAILABLE_NV:
-        if (eglStreamAcquireImageNV(m_display, m_eglStream, &m_eglImage, EGL_NO_SYNC))
-            return m_eglImage;
+        // Should not happen as every stream image is announced by an EGL_STREAM_IMAGE_ADD_NV event
+        g_warning("Unknown EGLImage acquired from the consumer EGLStream");
+        eglStreamReleaseImageNV(m_display, m_eglStream, image, EGL_NO_SYNC);
         break;
+    }
 
     default:
         break;
     }
 
-    return EGL_NO_IMAGE;
+    return false;
 }
 
-bool EGLConsumerStream::releaseFrame() const noexcept
+bool EGLConsumerStream::releaseFrame(EGLSync releaseSync) noexcept
 {
-    if (!m_eglImage)
-        return false;
+    bool result = false;
+    if (m_acquiredImage)
+    {
+        result = eglStreamReleaseImageNV(m_display, m_eglStream, m_acquiredImage, releaseSync);
+        m_acquiredImage = EGL_NO_IMAGE;
+    }
+
+    // The producer holds its own reference on the fence until it is signaled
+    if (releaseSync)
+        eglDestroySync(m_display, releaseSync);
+
+    return result;
+}
+
+void EGLConsumerStream::addImage() noexcept
+{
+    EGLImage image = eglCreateImage(m_display, EGL_NO_CONTEXT, EGL_STREAM_CONSUMER_IMAGE_NV,
+                                    static_cast<EGLClientBuffer>(m_eglStream), nullptr);
+    if (!image)
+    {
+        g_warning("Cannot create an EGLImage for a new consumer EGLStream buffer");
+        return;
+    }
+
+    // Reuse the first free slot so that indices stay small and stable across stream reallocations
+    for (Slot& slot : m_slots)
+    {
+        if (!slot.image)
+        {
+            slot.image = image;
+            slot.generation = createSlotGeneration();
+            return;
+        }
+    }
+
+    m_slots.push_back({image, createSlotGeneration()});
+}
+
+void EGLConsumerStream::removeImage(EGLImage image) noexcept
+{
+    for (Slot& slot : m_slots)
+    {
+        if (slot.image == image)
+        {
+            slot.image = EGL_NO_IMAGE;
+            break;
+        }
+    }
+
+    if (image == m_acquiredImage)
+        m_acquiredImage = EGL_NO_IMAGE;
 
-    return eglStreamReleaseImageNV(m_display, m_eglStream, m_eglImage, EGL_NO_SYNC);
+    eglDestroyImage(m_display, image);
 }
 
 std::unique_ptr<EGLProducerStream> EGLProducerStream::createEGLStream(EGLDisplay display, EGLContext ctx, EGLint width,
@@ -255,6 +311,8 @@ std::unique_ptr<EGLProducerStream> EGLProducerStream::createEGLStream(EGLDisplay
     if (!stream->m_eglSurface)
         return nullptr;
 
+    stream->m_hasFrameIdMetadata = initEGLStreamMetadataExtension(display);
+
     return stream;
 }
 
@@ -267,12 +325,17 @@ EGLProducerStream::~EGLProducerStream()
     }
 }
 
-bool EGLProducerStream::makeCurrent() const noexcept
+bool EGLProducerStream::makeCurrent() noexcept
 {
     return eglMakeCurrent(m_display, m_eglSurface, m_eglSurface, m_eglContext);
 }
 
-bool EGLProducerStream::swapBuffers() const noexcept
+bool EGLProducerStream::swapBuffers(uint64_t frameId) noexcept
 {
+    // The metadata are latched with the next frame inserted into the stream. Setting them fails if the consumer didn't
+    // allocate the metadata block, in which case they are not set anymore.
+    if (m_hasFrameIdMetadata)
+        m_hasFrameIdMetadata = eglSetStreamMetadataNV(m_display, m_eglStream, 0, 0, sizeof(frameId), &frameId);
+
     return eglSwapBuffers(m_display, m_eglSurface);
 }
@@ -26,10 +26,14 @@
 
 #pragma once
 
+#include "FrameTransport.h"
+
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 class EGLStream
 {
@@ -63,12 +67,22 @@ class EGLStream
     EGLStreamKHR m_eglStream = EGL_NO_STREAM_KHR;
 };
 
-class EGLConsumerStream final : public EGLStream
+class EGLConsumerStream final : public EGLStream, public FrameConsumer
 {
   public:
     static constexpr int ACQUIRE_MAX_TIMEOUT_USEC = 1000 * 1000;
 
-    static std::unique_ptr<EGLConsumerStream> createEGLStream(EGLDisplay display) noexcept;
+    // A FIFO length of 0 puts the stream in mailbox mode: the producer never blocks and the consumer always acquires
+    // the latest frame. A positive length lets the producer queue that many frames ahead of the consumer.
+    static constexpr EGLint MAILBOX_FIFO_LENGTH = 0;
+    static constexpr EGLint DEFAULT_FIFO_LENGTH = 1;
+
+    // With explicit synchronization, frames are acquired without waiting for the producer rendering, and are given
+    // with an acquire sync (when supported) which must be waited for before reading them. Otherwise the acquisition
+    // waits for the rendering implicitly.
+    static std::unique_ptr<EGLConsumerStream> createEGLStream(EGLDisplay display,
+                                                              EGLint fifoLength = DEFAULT_FIFO_LENGTH,
+                                                              bool explicitSync = false) noexcept;
 
     ~EGLConsumerStream() override;
 
@@ -79,8 +93,13 @@ class EGLConsumerStream final : public EGLStream
 
     void closeStreamFD() noexcept;
 
-    EGLImage acquireFrame() noexcept;
-    bool releaseFrame() const noexcept;
+    bool acquireFrame(Frame& frame, int timeoutUsec) noexcept override;
+    bool releaseFrame(EGLSync releaseSync = EGL_NO_SYNC) noexcept override;
+
+    bool isDisconnected() const noexcept override
+    {
+        return getStatus() == StreamStatus::Disconnected;
+    }
 
   private:
     EGLConsumerStream(EGLDisplay display) : EGLStream(display)
@@ -88,10 +107,23 @@ class EGLConsumerStream final : public EGLStream
     }
 
     int m_streamFD = -1;
-    EGLImage m_eglImage = EGL_NO_IMAGE;
+
+    struct Slot
+    {
+        EGLImage image = EGL_NO_IMAGE;
+        uint32_t generation = 0;
+    };
+    std::vector<Slot> m_slots;
+    EGLImage m_acquiredImage = EGL_NO_IMAGE;
+    EGLSync m_acquireSync = EGL_NO_SYNC;
+    // Frame identifiers are transported as stream metadata when supported
+    bool m_hasFrameIdMetadata = false;
+
+    void addImage() noexcept;
+    void removeImage(EGLImage image) noexcept;
 };
 
-class EGLProducerStream final : public EGLStream
+class EGLProducerStream final : public EGLStream, public FrameProducer
 {
   public:
     static std::unique_ptr<EGLProducerStream> createEGLStream(EGLDisplay display, EGLContext ctx, EGLint width,
@@ -99,8 +131,8 @@ class EGLProducerStream final : public EGLStream
 
     ~EGLProducerStream() override;
 
-    bool makeCurrent() const noexcept;
-    bool swapBuffers() const noexcept;
+    bool makeCurrent() noexcept override;
+    bool swapBuffers(uint64_t frameId) noexcept override;
 
   private:
     EGLProducerStream(EGLDisplay display) : EGLStream(display)
@@ -109,4 +141,5 @@ class EGLProducerStream final : public EGLStream
 
     EGLContext m_eglContext = EGL_NO_CONTEXT;
     EGLSurface m_eglSurface = EGL_NO_SURFACE;
+    bool m_hasFrameIdMetadata = false;
 };
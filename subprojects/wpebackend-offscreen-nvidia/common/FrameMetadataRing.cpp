@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FrameMetadataRing.h"
+
+#include <atomic>
+#include <cerrno>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct FrameMetadataRing::SharedData
+{
+    // Producer and consumer indexes are kept on separate cache lines to avoid false sharing
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> consumerWaiting;
+    FrameMetadata entries[CAPACITY];
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory atomics must be lock-free");
+
+namespace
+{
+void ringDoorbell(int doorbellFD) noexcept
+{
+    const uint64_t value = 1;
+    while ((write(doorbellFD, &value, sizeof(value)) == -1) && (errno == EINTR))
+        continue;
+}
+} // namespace
+
+std::unique_ptr<FrameMetadataRing> FrameMetadataRing::create() noexcept
+{
+    std::unique_ptr<FrameMetadataRing> ring(new FrameMetadataRing());
+    ring->m_memoryFD = memfd_create("wpe-frame-metadata-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (ring->m_memoryFD == -1)
+        return nullptr;
+
+    if (ftruncate(ring->m_memoryFD, sizeof(SharedData)) == -1)
+        return nullptr;
+
+    // The producer side must not be able to resize the shared memory under the consumer
+    if (fcntl(ring->m_memoryFD, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+        return nullptr;
+
+    ring->m_doorbellFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ring->m_doorbellFD == -1)
+        return nullptr;
+
+    if (!ring->map(true))
+        return nullptr;
+
+    return ring;
+}
+
+std::unique_ptr<FrameMetadataRing> FrameMetadataRing::createFromFileDescriptors(int memoryFD, int doorbellFD) noexcept
+{
+    std::unique_ptr<FrameMetadataRing> ring(new FrameMetadataRing());
+    ring->m_memoryFD = memoryFD;
+    ring->m_doorbellFD = doorbellFD;
+    if ((memoryFD == -1) || (doorbellFD == -1))
+        return nullptr;
+
+    struct stat memoryStat = {};
+    if ((fstat(memoryFD, &memoryStat) == -1) || (memoryStat.st_size != sizeof(SharedData)))
+        return nullptr;
+
+    if (!ring->map(false))
+        return nullptr;
+
+    ring->closeMemoryFD();
+    return ring;
+}
+
+FrameMetadataRing::~FrameMetadataRing()
+{
+    if (m_sharedData)
+        munmap(m_sharedData, sizeof(SharedData));
+
+    if (m_doorbellFD != -1)
+        close(m_doorbellFD);
+
+    closeMemoryFD();
+}
+
+void FrameMetadataRing::closeMemoryFD() noexcept
+{
+    if (m_memoryFD != -1)
+    {
+        close(m_memoryFD);
+        m_memoryFD = -1;
+    }
+}
+
+bool FrameMetadataRing::map(bool initialize) noexcept
+{
+    void* data = mmap(nullptr, sizeof(SharedData), PROT_READ | PROT_WRITE, MAP_SHARED, m_memoryFD, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    // The memory file is zero-filled at creation, which is a valid empty ring state
+    m_sharedData = initialize ? new (data) SharedData() : static_cast<SharedData*>(data);
+    return true;
+}
+
+bool FrameMetadataRing::push(const FrameMetadata& metadata) noexcept
+{
+    const uint32_t head = m_sharedData->head.load(std::memory_order_relaxed);
+    const uint32_t tail = m_sharedData->tail.load(std::memory_order_acquire);
+    if ((head - tail) >= CAPACITY)
+        return false;
+
+    m_sharedData->entries[head & (CAPACITY - 1)] = metadata;
+    m_sharedData->head.store(head + 1, std::memory_order_seq_cst);
+
+    // Pairs with armDoorbell(): either the consumer sees the new entry, or the producer sees the armed doorbell
+    if (m_sharedData->consumerWaiting.exchange(0, std::memory_order_seq_cst))
+        ringDoorbell(m_doorbellFD);
+
+    return true;
+}
+
+bool FrameMetadataRing::pop(FrameMetadata& metadata) noexcept
+{
+    const uint32_t tail = m_sharedData->tail.load(std::memory_order_relaxed);
+    const uint32_t head = m_sharedData->head.load(std::memory_order_acquire);
+    if (head == tail)
+        return false;
+
+    metadata = m_sharedData->entries[tail & (CAPACITY - 1)];
+    m_sharedData->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool FrameMetadataRing::armDoorbell() noexcept
+{
+    m_sharedData->consumerWaiting.store(1, std::memory_order_seq_cst);
+
+    // Entries pushed before the doorbell was armed did not ring it, the caller must pop them first
+    const uint32_t tail = m_sharedData->tail.load(std::memory_order_relaxed);
+    if (m_sharedData->head.load(std::memory_order_seq_cst) != tail)
+    {
+        m_sharedData->consumerWaiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+void FrameMetadataRing::disarmDoorbell() noexcept
+{
+    m_sharedData->consumerWaiting.store(0, std::memory_order_relaxed);
+}
+
+void FrameMetadataRing::clearDoorbell() noexcept
+{
+    uint64_t value = 0;
+    while ((read(m_doorbellFD, &value, sizeof(value)) == -1) && (errno == EINTR))
+        continue;
+}
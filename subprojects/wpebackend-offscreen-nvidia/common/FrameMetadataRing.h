@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+struct FrameMetadata
+{
+    uint64_t frameId = 0;
+    // Monotonic time in microseconds at which the frame was rendered on WPEWebProcess side
+    int64_t renderedTime = 0;
+};
+
+// Lock-free single-producer/single-consumer ring living in a shared memory file, used to transfer per-frame metadata
+// from the WPEWebProcess (producer) to the application process (consumer) without any system call in the steady
+// state. The consumer can arm an eventfd doorbell, that the producer will ring on its next push, when it needs to
+// be woken up.
+class FrameMetadataRing final
+{
+  public:
+    static constexpr uint32_t CAPACITY = 64;
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "FrameMetadataRing capacity must be a power of two");
+
+    // Creates a new shared ring on consumer side
+    static std::unique_ptr<FrameMetadataRing> create() noexcept;
+
+    // Maps a shared ring received from the consumer on producer side, taking the ownership of the file descriptors
+    static std::unique_ptr<FrameMetadataRing> createFromFileDescriptors(int memoryFD, int doorbellFD) noexcept;
+
+    ~FrameMetadataRing();
+
+    FrameMetadataRing(FrameMetadataRing&&) = delete;
+    FrameMetadataRing& operator=(FrameMetadataRing&&) = delete;
+    FrameMetadataRing(const FrameMetadataRing&) = delete;
+    FrameMetadataRing& operator=(const FrameMetadataRing&) = delete;
+
+    int getMemoryFD() const noexcept
+    {
+        return m_memoryFD;
+    }
+
+    int getDoorbellFD() const noexcept
+    {
+        return m_doorbellFD;
+    }
+
+    void closeMemoryFD() noexcept;
+
+    // Producer side
+    bool push(const FrameMetadata& metadata) noexcept;
+
+    // Consumer side
+    bool pop(FrameMetadata& metadata) noexcept;
+    // Returns false without arming the doorbell when entries are already available
+    bool armDoorbell() noexcept;
+    // Entries pushed afterwards don't ring the doorbell anymore, it may still have been rung in between
+    void disarmDoorbell() noexcept;
+    void clearDoorbell() noexcept;
+
+  private:
+    struct SharedData;
+
+    FrameMetadataRing() = default;
+    bool map(bool initialize) noexcept;
+
+    int m_memoryFD = -1;
+    int m_doorbellFD = -1;
+    SharedData* m_sharedData = nullptr;
+};
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FrameTransport.h"
+
+#include "ipc-messages.h"
+
+#include <glib.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+uint32_t getAllowedTransports() noexcept
+{
+    const char* value = std::getenv(FrameTransport::ENV_VARIABLE);
+    if (!value || !*value)
+        return IPC::ProtocolHandshake::TRANSPORT_CAPABILITIES;
+
+    if (std::strcmp(value, "eglstream") == 0)
+        return IPC::ProtocolHandshake::EGLStreamTransport;
+
+    if (std::strcmp(value, "dmabuf") == 0)
+        return IPC::ProtocolHandshake::DMABufTransport;
+
+    g_warning("Unknown frame transport %s in %s, ignored", value, FrameTransport::ENV_VARIABLE);
+    return IPC::ProtocolHandshake::TRANSPORT_CAPABILITIES;
+}
+
+bool hasExtensions(const char* extensions, std::initializer_list<const char*> names) noexcept
+{
+    if (!extensions)
+        return false;
+
+    for (const char* name : names)
+    {
+        // Extension names are separated by spaces, a name must not match the prefix of a longer one
+        const size_t length = std::strlen(name);
+        const char* position = extensions;
+        bool found = false;
+        while ((position = std::strstr(position, name)) != nullptr)
+        {
+            if (((position == extensions) || (position[-1] == ' ')) &&
+                ((position[length] == ' ') || (position[length] == '\0')))
+            {
+                found = true;
+                break;
+            }
+            position += length;
+        }
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+} // namespace
+
+bool FrameTransport::hasEGLExtensions(EGLDisplay display, std::initializer_list<const char*> names) noexcept
+{
+    if (!display)
+        return false;
+
+    return hasExtensions(eglQueryString(display, EGL_EXTENSIONS), names);
+}
+
+bool FrameTransport::hasEGLClientExtensions(std::initializer_list<const char*> names) noexcept
+{
+    // Fails with EGL_BAD_DISPLAY on EGL implementations without client extensions
+    return hasExtensions(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), names);
+}
+
+uint32_t FrameTransport::getSupportedConsumerTransports(EGLDisplay display) noexcept
+{
+    uint32_t transports = 0;
+    if (hasEGLExtensions(display,
+                         {"EGL_KHR_stream", "EGL_KHR_stream_cross_process_fd", "EGL_NV_stream_consumer_eglimage"}))
+        transports |= IPC::ProtocolHandshake::EGLStreamTransport;
+
+    if (hasEGLExtensions(display, {"EGL_EXT_image_dma_buf_import"}))
+        transports |= IPC::ProtocolHandshake::DMABufTransport;
+
+    return transports;
+}
+
+uint32_t FrameTransport::getSupportedProducerTransports(EGLDisplay display) noexcept
+{
+    uint32_t transports = 0;
+    if (hasEGLExtensions(display,
+                         {"EGL_KHR_stream", "EGL_KHR_stream_cross_process_fd", "EGL_KHR_stream_producer_eglsurface"}))
+        transports |= IPC::ProtocolHandshake::EGLStreamTransport;
+
+    if (hasEGLExtensions(display, {"EGL_MESA_image_dma_buf_export", "EGL_KHR_gl_texture_2D_image"}))
+        transports |= IPC::ProtocolHandshake::DMABufTransport;
+
+    return transports;
+}
+
+bool FrameTransport::hasNativeFenceSync(EGLDisplay display) noexcept
+{
+    return hasEGLExtensions(display, {"EGL_KHR_fence_sync", "EGL_KHR_wait_sync", "EGL_ANDROID_native_fence_sync"});
+}
+
+uint32_t FrameTransport::selectTransport(uint32_t localCapabilities, uint32_t peerCapabilities) noexcept
+{
+    // Peers which don't advertise any transport (older versions) only support EGLStreams
+    uint32_t peerTransports = peerCapabilities & IPC::ProtocolHandshake::TRANSPORT_CAPABILITIES;
+    if (!peerTransports)
+        peerTransports = IPC::ProtocolHandshake::EGLStreamTransport;
+
+    const uint32_t transports = localCapabilities & peerTransports & getAllowedTransports();
+    if (transports & IPC::ProtocolHandshake::EGLStreamTransport)
+        return IPC::ProtocolHandshake::EGLStreamTransport;
+
+    if (transports & IPC::ProtocolHandshake::DMABufTransport)
+        return IPC::ProtocolHandshake::DMABufTransport;
+
+    return 0;
+}
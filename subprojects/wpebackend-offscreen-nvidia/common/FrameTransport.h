@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <initializer_list>
+
+// Frames rendered on WPEWebProcess side are handed over to the application process through a frame transport, made of
+// a FrameProducer on RendererBackendEGLTarget side and a FrameConsumer on ViewBackend side. The transport is picked at
+// runtime during the IPC protocol handshake, among the ones supported by the EGL implementations of both sides.
+
+class FrameConsumer
+{
+  public:
+    virtual ~FrameConsumer() = default;
+
+    FrameConsumer(FrameConsumer&&) = delete;
+    FrameConsumer& operator=(FrameConsumer&&) = delete;
+    FrameConsumer(const FrameConsumer&) = delete;
+    FrameConsumer& operator=(const FrameConsumer&) = delete;
+
+    // Frames are backed by EGLImages kept alive in slots until the producer removes them. A slot index is stable for
+    // as long as its generation is unchanged, so per-slot resources can be cached by the consumer. Generations are
+    // never 0, and a (slot, generation) pair is never reused within a view, even when its frame consumer is replaced.
+    struct Frame
+    {
+        EGLImage image = EGL_NO_IMAGE;
+        uint32_t slot = 0;
+        uint32_t slotGeneration = 0;
+        // Signaled once the producer rendering into the image is complete (EGL_NO_SYNC if unsupported)
+        EGLSync acquireSync = EGL_NO_SYNC;
+        // Identifier given by the producer to the frame, matching the frame metadata (0 if it cannot be transported)
+        uint64_t frameId = 0;
+    };
+
+    // Waits for the next frame at most timeoutUsec, a timeout of 0 only processes the pending frame events
+    virtual bool acquireFrame(Frame& frame, int timeoutUsec) noexcept = 0;
+    // The optional release sync is a fence signaled once the consumer is done with the image. Its ownership is
+    // transferred to the consumer, which destroys it.
+    virtual bool releaseFrame(EGLSync releaseSync = EGL_NO_SYNC) noexcept = 0;
+    // Gives back the released frames whose release fence is now signaled, without waiting for the other ones. Returns
+    // true while some releases are still pending.
+    virtual bool processPendingReleases() noexcept
+    {
+        return false;
+    }
+
+    // True once no frame can be received anymore
+    virtual bool isDisconnected() const noexcept = 0;
+
+  protected:
+    FrameConsumer() = default;
+};
+
+class FrameProducer
+{
+  public:
+    virtual ~FrameProducer() = default;
+
+    FrameProducer(FrameProducer&&) = delete;
+    FrameProducer& operator=(FrameProducer&&) = delete;
+    FrameProducer(const FrameProducer&) = delete;
+    FrameProducer& operator=(const FrameProducer&) = delete;
+
+    // Binds the buffer of the next frame as the current draw target of the producer EGLContext. Returns false without
+    // blocking when no buffer is available, the frame is then dropped.
+    virtual bool makeCurrent() noexcept = 0;
+    // Hands the rendered frame over to the consumer, along with its identifier when the transport supports it
+    virtual bool swapBuffers(uint64_t frameId) noexcept = 0;
+
+  protected:
+    FrameProducer() = default;
+};
+
+class FrameTransport final
+{
+  public:
+    FrameTransport() = delete;
+
+    // Environment variable restricting the transport selected by the application process ("eglstream" or "dmabuf")
+    static constexpr const char* ENV_VARIABLE = "WPE_OFFSCREEN_NVIDIA_FRAME_TRANSPORT";
+
+    // Checks that the display is initialized and supports all the given EGL extensions
+    static bool hasEGLExtensions(EGLDisplay display, std::initializer_list<const char*> names) noexcept;
+    // Same for the client extensions, which don't depend on any display
+    static bool hasEGLClientExtensions(std::initializer_list<const char*> names) noexcept;
+
+    // Both return a combination of the IPC::ProtocolHandshake transport capabilities
+    static uint32_t getSupportedConsumerTransports(EGLDisplay display) noexcept;
+    static uint32_t getSupportedProducerTransports(EGLDisplay display) noexcept;
+
+    // Fences exported as file descriptors and waited for on the GPU, used to release DMA-BUF buffers across processes
+    static bool hasNativeFenceSync(EGLDisplay display) noexcept;
+
+    // Returns the single transport capability to use given the local and peer capabilities, EGLStreams being preferred
+    // as they avoid any IPC round-trip per frame. Returns 0 if there is no common transport.
+    static uint32_t selectTransport(uint32_t localCapabilities, uint32_t peerCapabilities) noexcept;
+};
@@ -28,21 +28,83 @@
 
 #include "ipc.h"
 
+#include <algorithm>
+#include <array>
+
 namespace IPC
 {
+// Each message type declares a Payload structure, file descriptors (if any) must be its first members.
+// Message types are registered in the MessageRegistry instances at the end of this file, which statically check the
+// payload sizes and build the dispatch tables.
+
+class ProtocolHandshake final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 1;
+
+    // Must be incremented when the meaning of an existing message changes. New messages only need a new capability,
+    // so that they are only used when both sides support them.
+    static constexpr uint16_t PROTOCOL_VERSION = 1;
+
+    enum Capability : uint32_t
+    {
+        FrameMetadataRing = 1 << 0,
+        // Frame transports, see FrameTransport. Each side advertises the ones supported by its EGL implementation,
+        // and the ViewBackend answers with the single one selected.
+        EGLStreamTransport = 1 << 1,
+        DMABufTransport = 1 << 2,
+        // The RendererBackendEGLTarget renegotiates its EGLStream on resize, and accepts surface size buckets
+        LiveResize = 1 << 3,
+        // The RendererBackendEGLTarget announces each frame presented to the EGLStream with an EGLStreamFrame message
+        EGLStreamFrameNotification = 1 << 4,
+        // The DMA-BUF buffers are released with a native fence (EGL_ANDROID_native_fence_sync) waited for on the GPU by
+        // the producer, see DMABufReleaseFence
+        DMABufReleaseFence = 1 << 5
+    };
+    static constexpr uint32_t TRANSPORT_CAPABILITIES = EGLStreamTransport | DMABufTransport;
+    static constexpr uint32_t SUPPORTED_CAPABILITIES =
+        FrameMetadataRing | TRANSPORT_CAPABILITIES | LiveResize | EGLStreamFrameNotification | DMABufReleaseFence;
+
+    struct Payload
+    {
+        uint16_t version;
+        uint32_t capabilities;
+    };
+
+    ProtocolHandshake(uint16_t version, uint32_t capabilities) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {version, capabilities};
+    }
+
+    uint16_t getVersion() const noexcept
+    {
+        return getPayload<Payload>()->version;
+    }
+
+    uint32_t getCapabilities() const noexcept
+    {
+        return getPayload<Payload>()->capabilities;
+    }
+};
+
 class EGLStreamFileDescriptor final : public Message
 {
   public:
     static constexpr uint16_t MESSAGE_CODE = 3;
 
+    struct Payload
+    {
+        int fd;
+    };
+
     EGLStreamFileDescriptor(int fd) : Message(MESSAGE_CODE, 1)
     {
-        *getPayload<int>() = fd;
+        *getPayload<Payload>() = {fd};
     }
 
     int getFD() const noexcept
     {
-        return *getPayload<int>();
+        return getPayload<Payload>()->fd;
     }
 };
 
@@ -58,14 +120,374 @@ class EGLStreamState final : public Message
         Error
     };
 
+    struct Payload
+    {
+        State state;
+    };
+
     EGLStreamState(State state) : Message(MESSAGE_CODE)
     {
-        *getPayload<State>() = state;
+        *getPayload<Payload>() = {state};
     }
 
     State getState() const noexcept
     {
-        return *getPayload<State>();
+        return getPayload<Payload>()->state;
+    }
+};
+
+class FrameMetadataRingFileDescriptors final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 5;
+
+    struct Payload
+    {
+        int memoryFD;
+        int doorbellFD;
+    };
+
+    FrameMetadataRingFileDescriptors(int memoryFD, int doorbellFD) : Message(MESSAGE_CODE, 2)
+    {
+        *getPayload<Payload>() = {memoryFD, doorbellFD};
+    }
+
+    int getMemoryFD() const noexcept
+    {
+        return getPayload<Payload>()->memoryFD;
+    }
+
+    int getDoorbellFD() const noexcept
+    {
+        return getPayload<Payload>()->doorbellFD;
+    }
+};
+
+// Announces a buffer of the DMA-BUF frame transport pool, sent by the producer before using it for the first time or
+// after reallocating it. Only single-plane buffers at offset 0 are exchanged.
+class DMABufBuffer final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 6;
+    static constexpr uint32_t MAX_BUFFER_COUNT = 8;
+
+    struct Payload
+    {
+        int fd;
+        uint32_t index;
+        uint32_t fourcc;
+        uint32_t stride;
+        uint32_t modifierLow;
+        uint32_t modifierHigh;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    DMABufBuffer(int fd, uint32_t index, uint32_t fourcc, uint32_t stride, uint64_t modifier, uint16_t width,
+                 uint16_t height)
+        : Message(MESSAGE_CODE, 1)
+    {
+        *getPayload<Payload>() = {fd,
+                                  index,
+                                  fourcc,
+                                  stride,
+                                  static_cast<uint32_t>(modifier & 0xFFFFFFFF),
+                                  static_cast<uint32_t>(modifier >> 32),
+                                  width,
+                                  height};
+    }
+
+    int getFD() const noexcept
+    {
+        return getPayload<Payload>()->fd;
+    }
+
+    uint32_t getIndex() const noexcept
+    {
+        return getPayload<Payload>()->index;
+    }
+
+    uint32_t getFourCC() const noexcept
+    {
+        return getPayload<Payload>()->fourcc;
+    }
+
+    uint32_t getStride() const noexcept
+    {
+        return getPayload<Payload>()->stride;
+    }
+
+    uint64_t getModifier() const noexcept
+    {
+        const Payload* payload = getPayload<Payload>();
+        return (static_cast<uint64_t>(payload->modifierHigh) << 32) | payload->modifierLow;
+    }
+
+    uint16_t getWidth() const noexcept
+    {
+        return getPayload<Payload>()->width;
+    }
+
+    uint16_t getHeight() const noexcept
+    {
+        return getPayload<Payload>()->height;
+    }
+};
+
+// Sent by the DMA-BUF frame transport producer once a frame has been rendered into the given buffer. The generation
+// counts the DMABufBuffer messages sent for this buffer index, so that messages about reallocated buffers are ignored.
+class DMABufFrame final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 7;
+
+    struct Payload
+    {
+        uint32_t index;
+        uint32_t generation;
+        uint32_t frameIdLow;
+        uint32_t frameIdHigh;
+    };
+
+    DMABufFrame(uint32_t index, uint32_t generation, uint64_t frameId) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {index, generation, static_cast<uint32_t>(frameId & 0xFFFFFFFF),
+                                  static_cast<uint32_t>(frameId >> 32)};
+    }
+
+    uint32_t getIndex() const noexcept
+    {
+        return getPayload<Payload>()->index;
+    }
+
+    uint32_t getGeneration() const noexcept
+    {
+        return getPayload<Payload>()->generation;
+    }
+
+    uint64_t getFrameId() const noexcept
+    {
+        const Payload* payload = getPayload<Payload>();
+        return (static_cast<uint64_t>(payload->frameIdHigh) << 32) | payload->frameIdLow;
+    }
+};
+
+// Sent by the DMA-BUF frame transport consumer once it is done with the given buffer, which can then be reused
+class DMABufRelease final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 8;
+
+    struct Payload
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    DMABufRelease(uint32_t index, uint32_t generation) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {index, generation};
+    }
+
+    uint32_t getIndex() const noexcept
+    {
+        return getPayload<Payload>()->index;
+    }
+
+    uint32_t getGeneration() const noexcept
+    {
+        return getPayload<Payload>()->generation;
+    }
+};
+
+// Same as DMABufRelease, but the buffer may still be read until the given native fence file descriptor is signaled.
+// Only sent with the DMABufReleaseFence capability.
+class DMABufReleaseFence final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 12;
+
+    struct Payload
+    {
+        int fd;
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    DMABufReleaseFence(int fd, uint32_t index, uint32_t generation) : Message(MESSAGE_CODE, 1)
+    {
+        *getPayload<Payload>() = {fd, index, generation};
+    }
+
+    int getFD() const noexcept
+    {
+        return getPayload<Payload>()->fd;
+    }
+
+    uint32_t getIndex() const noexcept
+    {
+        return getPayload<Payload>()->index;
+    }
+
+    uint32_t getGeneration() const noexcept
+    {
+        return getPayload<Payload>()->generation;
+    }
+};
+
+// Surface sizes preallocated by the RendererBackendEGLTarget: the view is rendered into the smallest bucket containing
+// it, so that resizing within a bucket doesn't reallocate the frame buffers. Only sent with the LiveResize capability.
+class SurfaceSizeBuckets final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 9;
+    static constexpr uint16_t MAX_BUCKET_COUNT = 6;
+
+    struct Size
+    {
+        uint16_t width;
+        uint16_t height;
+    };
+
+    struct Payload
+    {
+        uint16_t count;
+        Size sizes[MAX_BUCKET_COUNT];
+    };
+
+    SurfaceSizeBuckets(const Size* sizes, uint16_t count) : Message(MESSAGE_CODE)
+    {
+        Payload* payload = getPayload<Payload>();
+        payload->count = std::min(count, MAX_BUCKET_COUNT);
+        std::copy_n(sizes, payload->count, payload->sizes);
+    }
+
+    uint16_t getCount() const noexcept
+    {
+        return std::min(getPayload<Payload>()->count, MAX_BUCKET_COUNT);
+    }
+
+    const Size& getSize(uint16_t index) const noexcept
+    {
+        return getPayload<Payload>()->sizes[index];
     }
 };
+
+// EGL device index (see EGLDevice) used by the WPEWebProcess, sent by the RendererHostClient to the RendererBackendEGL
+// before the WPEWebProcess creates its display, then by each RendererBackendEGLTarget to its ViewBackend before the
+// handshake, so that frames are consumed on the device rendering them. Peers ignoring it keep the default display.
+class EGLDeviceSelection final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 10;
+
+    struct Payload
+    {
+        int32_t index;
+    };
+
+    EGLDeviceSelection(int32_t index) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {index};
+    }
+
+    int32_t getIndex() const noexcept
+    {
+        return getPayload<Payload>()->index;
+    }
+};
+
+// Sent by the EGLStream frame transport producer once a frame has been presented, as EGLStream events cannot be
+// waited for with a file descriptor. Only sent with the EGLStreamFrameNotification capability.
+class EGLStreamFrame final : public Message
+{
+  public:
+    static constexpr uint16_t MESSAGE_CODE = 11;
+
+    struct Payload
+    {
+        uint32_t frameIdLow;
+        uint32_t frameIdHigh;
+    };
+
+    EGLStreamFrame(uint64_t frameId) : Message(MESSAGE_CODE)
+    {
+        *getPayload<Payload>() = {static_cast<uint32_t>(frameId & 0xFFFFFFFF), static_cast<uint32_t>(frameId >> 32)};
+    }
+
+    uint64_t getFrameId() const noexcept
+    {
+        const Payload* payload = getPayload<Payload>();
+        return (static_cast<uint64_t>(payload->frameIdHigh) << 32) | payload->frameIdLow;
+    }
+};
+
+// Builds at compile time a dispatch table indexed by message code for the given message types. Handlers must
+// implement a handle(const MessageType&) method for each of them.
+template <typename... MessageTypes> class MessageRegistry final
+{
+  public:
+    MessageRegistry() = delete;
+
+    // Returns false if the message code is not part of the registry (like a message sent by a newer peer)
+    template <typename Handler> static bool dispatch(Handler& handler, const Message& message) noexcept
+    {
+        static constexpr auto s_dispatchTable = createDispatchTable<Handler>();
+
+        const uint16_t code = message.getCode();
+        if ((code >= s_dispatchTable.size()) || !s_dispatchTable[code])
+            return false;
+
+        s_dispatchTable[code](handler, message);
+        return true;
+    }
+
+  private:
+    static_assert(sizeof...(MessageTypes) > 0, "IPC message registry cannot be empty");
+    static_assert(((sizeof(typename MessageTypes::Payload) <= Message::PAYLOAD_SIZE) && ...),
+                  "IPC message payload is too large");
+    static_assert(((sizeof(MessageTypes) == Message::MESSAGE_SIZE) && ...), "IPC message cannot have extra members");
+
+    static constexpr uint16_t MAX_CODE = std::max({MessageTypes::MESSAGE_CODE...});
+
+    static constexpr bool hasUniqueCodes() noexcept
+    {
+        std::array<bool, MAX_CODE + 1> used = {};
+        for (uint16_t code : {MessageTypes::MESSAGE_CODE...})
+        {
+            if (used[code])
+                return false;
+            used[code] = true;
+        }
+        return true;
+    }
+    static_assert(hasUniqueCodes(), "IPC message codes must be unique");
+
+    template <typename Handler> using DispatchFunction = void (*)(Handler&, const Message&) noexcept;
+
+    template <typename Handler, typename MessageType>
+    static void dispatchMessage(Handler& handler, const Message& message) noexcept
+    {
+        handler.handle(static_cast<const MessageType&>(message));
+    }
+
+    template <typename Handler> static constexpr auto createDispatchTable() noexcept
+    {
+        std::array<DispatchFunction<Handler>, MAX_CODE + 1> table = {};
+        ((table[MessageTypes::MESSAGE_CODE] = &dispatchMessage<Handler, MessageTypes>), ...);
+        return table;
+    }
+};
+
+// Messages received on application process side by ViewBackend from RendererBackendEGLTarget
+using ViewBackendMessages = MessageRegistry<ProtocolHandshake, EGLStreamState, DMABufBuffer, DMABufFrame,
+                                            EGLDeviceSelection, EGLStreamFrame>;
+
+// Messages received on WPEWebProcess side by RendererBackendEGLTarget from ViewBackend
+using RendererBackendEGLTargetMessages =
+    MessageRegistry<ProtocolHandshake, EGLStreamFileDescriptor, FrameMetadataRingFileDescriptors, DMABufRelease,
+                    SurfaceSizeBuckets, DMABufReleaseFence>;
+
+// Messages received on WPEWebProcess side by RendererBackendEGL from RendererHostClient
+using RendererBackendEGLMessages = MessageRegistry<EGLDeviceSelection>;
 } // namespace IPC
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ipc-recorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace IPC;
+
+Recorder* Recorder::getInstance() noexcept
+{
+    // Never destroyed, as channels may still send messages while the process exits
+    static Recorder* s_recorder = create();
+    return s_recorder;
+}
+
+Recorder* Recorder::create() noexcept
+{
+    const char* prefix = g_getenv(ENV_VARIABLE);
+    if (!prefix || !*prefix)
+        return nullptr;
+
+    const std::string path = std::string(prefix) + "." + std::to_string(getpid()) + ".ipcrec";
+    FILE* file = std::fopen(path.c_str(), "wbe");
+    if (!file)
+    {
+        g_warning("Cannot open the IPC recording file %s", path.c_str());
+        return nullptr;
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, FileHeader::MAGIC, sizeof(header.magic));
+    header.version = FileHeader::VERSION;
+    header.recordSize = sizeof(Record);
+    header.pid = getpid();
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        std::fclose(file);
+        g_warning("Cannot write the IPC recording file %s", path.c_str());
+        return nullptr;
+    }
+
+    auto* recorder = new Recorder(file);
+    std::atexit(+[] { Recorder::getInstance()->flush(); });
+    g_message("Recording IPC messages into %s", path.c_str());
+    return recorder;
+}
+
+void Recorder::record(uint32_t channelId, Record::Direction direction, const Message& message) noexcept
+{
+    Record record = {};
+    record.timestamp = g_get_monotonic_time();
+    record.channelId = channelId;
+    record.direction = direction;
+    record.message = message;
+
+    // Records are buffered, and only flushed periodically to limit the impact on the recorded process
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::fwrite(&record, sizeof(record), 1, m_file);
+    if ((record.timestamp - m_lastFlushTime) >= FLUSH_INTERVAL_USEC)
+    {
+        std::fflush(m_file);
+        m_lastFlushTime = record.timestamp;
+    }
+}
+
+void Recorder::flush() noexcept
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::fflush(m_file);
+}
+
+std::unique_ptr<Replayer> Replayer::load(const char* path) noexcept
+{
+    FILE* file = std::fopen(path, "rbe");
+    if (!file)
+        return nullptr;
+
+    std::unique_ptr<Replayer> replayer(new Replayer());
+    FileHeader header = {};
+    if ((std::fread(&header, sizeof(header), 1, file) != 1) ||
+        (std::memcmp(header.magic, FileHeader::MAGIC, sizeof(header.magic)) != 0) ||
+        (header.version != FileHeader::VERSION) || (header.recordSize != sizeof(Record)))
+    {
+        std::fclose(file);
+        return nullptr;
+    }
+
+    Record record = {};
+    while (std::fread(&record, sizeof(record), 1, file) == 1)
+        replayer->m_records.push_back(record);
+
+    std::fclose(file);
+    return replayer;
+}
+
+Replayer::Statistics Replayer::replay(uint32_t channelId, int peerFd, bool maxSpeed, GMainContext* context) noexcept
+{
+    Statistics statistics = {};
+    m_replyCount = 0;
+
+    Channel channel(*this, peerFd);
+    channel.setMainContext(context);
+
+    const int64_t startTime = g_get_monotonic_time();
+    int64_t firstTimestamp = -1;
+    for (const Record& record : m_records)
+    {
+        if ((record.channelId != channelId) || (record.direction != Record::Direction::Received))
+            continue;
+
+        if (firstTimestamp == -1)
+            firstTimestamp = record.timestamp;
+
+        if (!maxSpeed)
+        {
+            const int64_t targetTime = startTime + (record.timestamp - firstTimestamp);
+            for (int64_t now = g_get_monotonic_time(); now < targetTime; now = g_get_monotonic_time())
+            {
+                if (!g_main_context_iteration(context, FALSE))
+                    g_usleep(std::min<int64_t>(targetTime - now, 1000));
+            }
+        }
+
+        Message message = record.message;
+        auto fds = message.getPayload<int>();
+        const uint16_t fdCount = std::min<uint16_t>(message.getFDCount(), Message::MAX_FD_COUNT);
+        for (uint16_t i = 0; i < fdCount; ++i)
+            fds[i] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+        const bool sent = channel.sendMessage(message);
+        for (uint16_t i = 0; i < fdCount; ++i)
+        {
+            if (fds[i] != -1)
+                close(fds[i]);
+        }
+
+        if (!sent)
+            break;
+
+        ++statistics.messageCount;
+        while (g_main_context_iteration(context, FALSE))
+            continue;
+    }
+
+    statistics.replyCount = m_replyCount;
+    statistics.duration = g_get_monotonic_time() - startTime;
+    return statistics;
+}
+
+void Replayer::handleMessage(Channel& /*channel*/, const Message& message) noexcept
+{
+    // Replies from the live channel are only counted
+    ++m_replyCount;
+
+    auto fds = message.getPayload<int>();
+    for (uint16_t i = 0; i < message.getFDCount(); ++i)
+        close(fds[i]);
+}
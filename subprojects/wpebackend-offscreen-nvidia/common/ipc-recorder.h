@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "ipc.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace IPC
+{
+// Recording file format (native endianness): a FileHeader followed by Record entries
+struct FileHeader
+{
+    static constexpr char MAGIC[8] = {'W', 'P', 'E', 'I', 'P', 'C', 'R', '\0'};
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    int32_t pid;
+    uint32_t reserved;
+};
+
+struct Record
+{
+    enum class Direction : uint8_t
+    {
+        Sent,
+        Received
+    };
+
+    int64_t timestamp; // Monotonic time in microseconds
+    uint32_t channelId;
+    Direction direction;
+    uint8_t reserved[3];
+    Message message;
+};
+static_assert(sizeof(Record) == 48, "IPC Record structure size is wrong");
+
+// Opt-in recorder of all IPC messages sent and received by the current process. It is enabled by setting the
+// WPE_OFFSCREEN_NVIDIA_IPC_RECORD environment variable to a path prefix, each process writing its records into the
+// "<prefix>.<pid>.ipcrec" file.
+class Recorder final
+{
+  public:
+    static constexpr const char* ENV_VARIABLE = "WPE_OFFSCREEN_NVIDIA_IPC_RECORD";
+
+    // Returns nullptr when recording is disabled
+    static Recorder* getInstance() noexcept;
+
+    void record(uint32_t channelId, Record::Direction direction, const Message& message) noexcept;
+    void flush() noexcept;
+
+    Recorder(Recorder&&) = delete;
+    Recorder& operator=(Recorder&&) = delete;
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+  private:
+    static constexpr int64_t FLUSH_INTERVAL_USEC = 100 * 1000;
+
+    Recorder(FILE* file) noexcept : m_file(file)
+    {
+    }
+    ~Recorder() = delete;
+
+    static Recorder* create() noexcept;
+
+    FILE* const m_file;
+    std::mutex m_mutex;
+    int64_t m_lastFlushTime = 0;
+};
+
+// Feeds the messages received by a recorded channel into a live channel endpoint, at the recorded pace or as fast as
+// possible, so that MessageHandler implementations can be exercised offline
+class Replayer final : private MessageHandler
+{
+  public:
+    struct Statistics
+    {
+        size_t messageCount;
+        size_t replyCount;
+        int64_t duration; // Microseconds
+    };
+
+    static std::unique_ptr<Replayer> load(const char* path) noexcept;
+
+    const std::vector<Record>& getRecords() const noexcept
+    {
+        return m_records;
+    }
+
+    // Sends the messages received by the channelId channel during the recording to the peerFd endpoint, iterating
+    // the context in between so that they are dispatched to the handler of the live channel. File descriptors
+    // carried by the recorded messages are replaced by /dev/null ones.
+    Statistics replay(uint32_t channelId, int peerFd, bool maxSpeed, GMainContext* context) noexcept;
+
+  private:
+    Replayer() = default;
+    void handleMessage(Channel& channel, const Message& message) noexcept override;
+
+    std::vector<Record> m_records;
+    size_t m_replyCount = 0;
+};
+} // namespace IPC
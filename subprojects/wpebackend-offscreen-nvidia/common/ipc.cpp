@@ -25,15 +25,148 @@
  */
 
 #include "ipc.h"
+#include "ipc-recorder.h"
 
+#include <glib-unix.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 
+#include <fcntl.h>
 #include <sys/socket.h>
 
 using namespace IPC;
 
-Channel::Channel(MessageHandler& handler) noexcept : m_handler(handler)
+namespace
+{
+union ControlBuffer {
+    cmsghdr header;
+    char buffer[CMSG_SPACE(Message::MAX_FD_COUNT * sizeof(int))];
+};
+
+void closeFileDescriptors(const Message& message) noexcept
+{
+    auto buffer = message.getPayload<int>();
+    for (uint16_t i = 0; i < message.getFDCount(); ++i)
+        close(buffer[i]);
+}
+
+bool unpackFileDescriptors(Message& message, const msghdr& msg, size_t length) noexcept
+{
+    int fds[Message::MAX_FD_COUNT] = {};
+    size_t fdCount = 0;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&msg); header; header = CMSG_NXTHDR(const_cast<msghdr*>(&msg), header))
+    {
+        if ((header->cmsg_level != SOL_SOCKET) || (header->cmsg_type != SCM_RIGHTS))
+            continue;
+
+        const size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i)
+        {
+            int fd = -1;
+            std::memcpy(&fd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (fdCount < Message::MAX_FD_COUNT)
+                fds[fdCount++] = fd;
+            else
+                close(fd);
+        }
+    }
+
+    if ((length != Message::MESSAGE_SIZE) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        (fdCount != message.getFDCount()))
+    {
+        for (size_t i = 0; i < fdCount; ++i)
+            close(fds[i]);
+
+        g_warning("Malformed message received on IPC channel");
+        return false;
+    }
+
+    // File descriptors in the payload are only meaningful in the sender process, replace them by the received ones
+    if (fdCount > 0)
+        std::memcpy(message.getPayload<int>(), fds, fdCount * sizeof(int));
+
+    return true;
+}
+
+void destroySource(GSource*& source) noexcept
+{
+    if (source)
+    {
+        g_source_destroy(source);
+        g_source_unref(source);
+        source = nullptr;
+    }
+}
+
+// Interval at which invokeAndWait checks whether the context is still run by another thread
+constexpr std::chrono::milliseconds INVOKE_ACQUIRE_INTERVAL(10);
+
+// Calls the function from the thread running the context and waits for its completion. The context may stop being run
+// in between, by a thread which only acquired it or exited its loop: the function is then called from this thread once
+// the context can be acquired, instead of waiting forever.
+template <typename Function> void invokeAndWait(GMainContext* context, Function&& function) noexcept
+{
+    struct Invocation
+    {
+        Function& function;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+    } invocation = {function, {}, {}, false};
+
+    GSource* source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(
+        source,
+        +[](gpointer data) -> gboolean {
+            auto* invocation = static_cast<Invocation*>(data);
+            invocation->function();
+
+            std::unique_lock<std::mutex> lock(invocation->mutex);
+            invocation->done = true;
+            invocation->condition.notify_all();
+            return G_SOURCE_REMOVE;
+        },
+        &invocation, nullptr);
+    g_source_attach(source, context);
+
+    std::unique_lock<std::mutex> lock(invocation.mutex);
+    while (!invocation.condition.wait_for(lock, INVOKE_ACQUIRE_INTERVAL, [&invocation] { return invocation.done; }))
+    {
+        lock.unlock();
+        if (g_main_context_acquire(context))
+        {
+            // Nothing can be dispatched from the context anymore, unless it completed in between
+            g_source_destroy(source);
+            lock.lock();
+            const bool done = invocation.done;
+            lock.unlock();
+
+            if (!done)
+                function();
+            g_main_context_release(context);
+            break;
+        }
+        lock.lock();
+    }
+
+    g_source_unref(source);
+}
+
+uint32_t createChannelId() noexcept
+{
+    static std::atomic<uint32_t> s_nextId = 1;
+    return s_nextId++;
+}
+} // namespace
+
+Channel::Channel(MessageHandler& handler) noexcept : m_id(createChannelId()), m_handler(handler)
 {
     int sockets[2] = {};
     if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0)
@@ -48,7 +181,7 @@ Channel::Channel(MessageHandler& handler) noexcept : m_handler(handler)
         close(sockets[1]);
 }
 
-Channel::Channel(MessageHandler& handler, int peerFd) noexcept : m_handler(handler)
+Channel::Channel(MessageHandler& handler, int peerFd) noexcept : m_id(createChannelId()), m_handler(handler)
 {
     if (peerFd == -1)
     {
@@ -59,42 +192,100 @@ Channel::Channel(MessageHandler& handler, int peerFd) noexcept : m_handler(handl
     configureLocalEndpoint(peerFd);
 }
 
-bool Channel::sendMessage(const Message& message) noexcept
+bool Channel::sendMessage(const Message& message, Delivery delivery) noexcept
 {
     if (m_localFd == -1)
         return false;
 
-    const ssize_t ret = send(m_localFd, &message, Message::MESSAGE_SIZE, MSG_EOR | MSG_NOSIGNAL);
-    if (ret == 0)
+    assert(message.getFDCount() <= Message::MAX_FD_COUNT);
+    auto buffer = message.getPayload<int>();
+    for (uint16_t i = 0; i < message.getFDCount(); ++i)
     {
-        closeChannel();
-        m_handler.handlePeerClosed(*this);
-        return false;
+        if (buffer[i] == -1)
+            return false;
     }
-    else if (ret == -1)
+
+    std::unique_lock<std::mutex> lock(m_sendQueueMutex);
+    if (m_sendQueue.empty())
     {
-        closeChannel();
-        m_handler.handleError(*this, errno);
-        return false;
+        if (writeMessage(message, m_maxSendQueueSize ? MSG_DONTWAIT : 0))
+            return true;
+
+        if (!m_maxSendQueueSize || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+        {
+            const int errnoValue = errno;
+            lock.unlock();
+            handleSendFailure(errnoValue);
+            return false;
+        }
     }
 
-    assert(ret == Message::MESSAGE_SIZE);
+    if (delivery == Delivery::Coalesced)
+    {
+        assert(!message.getFDCount());
+        auto queuedMessage = std::find_if(m_sendQueue.rbegin(), m_sendQueue.rend(), [&message](const Message& queued) {
+            return queued.getCode() == message.getCode();
+        });
+        if (queuedMessage != m_sendQueue.rend())
+        {
+            *queuedMessage = message;
+            return true;
+        }
+    }
+    else if ((delivery == Delivery::Droppable) && (m_sendQueue.size() >= m_maxSendQueueSize))
+    {
+        lock.unlock();
+        g_warning("IPC channel outgoing queue is full, message dropped");
+        return false;
+    }
 
-    auto fdCount = message.getFDCount();
-    if (fdCount > 0)
+    // The caller keeps the ownership of its file descriptors, so queued messages carry duplicates of them
+    Message queuedMessage = message;
+    auto queuedBuffer = queuedMessage.getPayload<int>();
+    for (uint16_t i = 0; i < queuedMessage.getFDCount(); ++i)
     {
-        assert(fdCount * sizeof(int) < Message::PAYLOAD_SIZE);
-        auto buffer = message.getPayload<int>();
-        for (uint16_t i = 0; i < fdCount; ++i)
+        queuedBuffer[i] = fcntl(buffer[i], F_DUPFD_CLOEXEC, 0);
+        if (queuedBuffer[i] == -1)
         {
-            if (!writeFileDescriptor(buffer[i]))
-                return false;
+            const int errnoValue = errno;
+            for (uint16_t j = 0; j < i; ++j)
+                close(queuedBuffer[j]);
+            lock.unlock();
+            g_warning("Cannot duplicate the file descriptors of a queued IPC message: %s", g_strerror(errnoValue));
+            return false;
         }
     }
+    m_sendQueue.push_back(queuedMessage);
+
+    if (!m_writableSource)
+        m_writableSource = createSocketSource(G_IO_OUT, writableCallback);
+
+    const size_t depth = m_sendQueue.size();
+    lock.unlock();
+
+    m_handler.handleSendQueueChanged(*this, depth);
+    if (depth == m_sendQueueHighWaterMark)
+        m_handler.handleSendQueueHighWater(*this, depth);
 
     return true;
 }
 
+void Channel::setNonBlockingSend(size_t maxQueueSize, size_t highWaterMark) noexcept
+{
+    // Pending messages are sent before going back to blocking mode, in order to preserve their ordering
+    if (!maxQueueSize && (m_localFd != -1) && !flushSendQueue(true))
+        return;
+
+    m_maxSendQueueSize = maxQueueSize;
+    m_sendQueueHighWaterMark = highWaterMark;
+}
+
+size_t Channel::getSendQueueDepth() const noexcept
+{
+    std::unique_lock<std::mutex> lock(m_sendQueueMutex);
+    return m_sendQueue.size();
+}
+
 int Channel::detachPeerFd() noexcept
 {
     int peerFd = m_peerFd;
@@ -104,12 +295,29 @@ int Channel::detachPeerFd() noexcept
 
 void Channel::closeChannel() noexcept
 {
-    if (m_idleSourceId)
+    // Sources attached to a context run by another thread must be destroyed from it, so that no message is being
+    // dispatched anymore when this returns
+    if (m_context && !g_main_context_acquire(m_context))
     {
-        g_source_remove(m_idleSourceId);
-        m_idleSourceId = 0;
+        invokeAndWait(m_context, [this] { closeChannelNow(); });
+        return;
     }
 
+    closeChannelNow();
+    if (m_context)
+        g_main_context_release(m_context);
+}
+
+void Channel::closeChannelNow() noexcept
+{
+    destroySource(m_socketSource);
+
+    std::unique_lock<std::mutex> lock(m_sendQueueMutex);
+    destroySource(m_writableSource);
+    for (const Message& message : m_sendQueue)
+        closeFileDescriptors(message);
+    m_sendQueue.clear();
+
     if (m_peerFd != -1)
     {
         close(m_peerFd);
@@ -123,46 +331,102 @@ void Channel::closeChannel() noexcept
     }
 }
 
+bool Channel::setMainContext(GMainContext* context) noexcept
+{
+    if (context == m_context)
+        return true;
+
+    if (m_context)
+        g_main_context_unref(m_context);
+    m_context = context ? g_main_context_ref(context) : nullptr;
+
+    if (m_localFd == -1)
+        return false;
+
+    destroySource(m_socketSource);
+    m_socketSource = createSocketSource(static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR), socketCallback);
+
+    std::unique_lock<std::mutex> lock(m_sendQueueMutex);
+    if (m_writableSource)
+    {
+        destroySource(m_writableSource);
+        m_writableSource = createSocketSource(G_IO_OUT, writableCallback);
+    }
+
+    return m_socketSource;
+}
+
 bool Channel::configureLocalEndpoint(int localFd) noexcept
 {
     assert(localFd != -1);
-    assert(!m_idleSourceId);
+    assert(!m_socketSource);
 
+    // The channel is only woken up when the socket is readable (or closed by the peer), instead of polling it
+    // continuously from the main loop
     m_localFd = localFd;
-    m_idleSourceId = g_idle_add(G_SOURCE_FUNC(idleCallback), this);
-    if (!m_idleSourceId)
+    m_socketSource = createSocketSource(static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR), socketCallback);
+    if (!m_socketSource)
     {
-        g_critical("Cannot attach idle source for IPC channel");
+        g_critical("Cannot attach socket source for IPC channel");
         return false;
     }
 
     return true;
 }
 
-gboolean Channel::idleCallback(Channel* channel) noexcept
+GSource* Channel::createSocketSource(GIOCondition condition,
+                                     gboolean (*callback)(gint, GIOCondition, Channel*)) noexcept
 {
-    Message message;
-    if (channel->readNextMessage(message))
-        channel->m_handler.handleMessage(*channel, message);
+    GSource* source = g_unix_fd_source_new(m_localFd, condition);
+    g_source_set_callback(source, G_SOURCE_FUNC(callback), this, nullptr);
+    if (!g_source_attach(source, m_context))
+    {
+        g_source_unref(source);
+        return nullptr;
+    }
+
+    return source;
+}
+
+void Channel::dispatchPendingMessages() noexcept
+{
+    while (receiveMessages())
+        continue;
+}
+
+gboolean Channel::socketCallback(gint /*fd*/, GIOCondition /*condition*/, Channel* channel) noexcept
+{
+    // Drain all pending messages in one wakeup. The channel may be closed (and even destroyed by its handler) when
+    // receiveMessages() returns false, so it must not be accessed anymore after that.
+    while (channel->receiveMessages())
+        continue;
 
     return G_SOURCE_CONTINUE;
 }
 
-bool Channel::readNextMessage(Message& message) noexcept
+bool Channel::receiveMessages() noexcept
 {
     if (m_localFd == -1)
         return false;
 
-    uint8_t byte;
-    ssize_t ret = recv(m_localFd, &byte, sizeof(byte), MSG_DONTWAIT | MSG_PEEK);
-    if (ret != sizeof(byte))
+    // Pull a batch of messages (and all their file descriptors) with a single call, then dispatch them in order
+    Message messages[RECEIVE_BATCH_SIZE];
+    ControlBuffer controls[RECEIVE_BATCH_SIZE];
+    iovec iovs[RECEIVE_BATCH_SIZE];
+    mmsghdr headers[RECEIVE_BATCH_SIZE] = {};
+    for (unsigned int i = 0; i < RECEIVE_BATCH_SIZE; ++i)
     {
-        if (ret == 0)
-        {
-            closeChannel();
-            m_handler.handlePeerClosed(*this);
-        }
-        else if ((ret == -1) && (errno != EWOULDBLOCK))
+        iovs[i] = {&messages[i], Message::MESSAGE_SIZE};
+        headers[i].msg_hdr.msg_iov = &iovs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_control = controls[i].buffer;
+        headers[i].msg_hdr.msg_controllen = sizeof(controls[i].buffer);
+    }
+
+    const int ret = recvmmsg(m_localFd, headers, RECEIVE_BATCH_SIZE, MSG_DONTWAIT | MSG_CMSG_CLOEXEC, nullptr);
+    if (ret == -1)
+    {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
         {
             closeChannel();
             m_handler.handleError(*this, errno);
@@ -171,103 +435,136 @@ bool Channel::readNextMessage(Message& message) noexcept
         return false;
     }
 
-    ret = recv(m_localFd, &message, Message::MESSAGE_SIZE, MSG_WAITALL);
-    if (ret == 0)
+    // Kept alive by the dispatch, as the handler may destroy the channel while processing any message
+    const std::shared_ptr<bool> alive = m_alive;
+    bool peerClosed = false;
+    for (int i = 0; i < ret; ++i)
     {
-        closeChannel();
-        m_handler.handlePeerClosed(*this);
-        return false;
+        // An empty message means that the peer closed the connection, after all the previously received messages
+        if (headers[i].msg_len == 0)
+        {
+            peerClosed = true;
+            break;
+        }
+
+        if (!unpackFileDescriptors(messages[i], headers[i].msg_hdr, headers[i].msg_len))
+            continue;
+
+        // The handler may have closed, or even destroyed, the channel while processing a previous message of the batch
+        if (!*alive || (m_localFd == -1))
+        {
+            closeFileDescriptors(messages[i]);
+            continue;
+        }
+
+        if (auto* recorder = Recorder::getInstance())
+            recorder->record(m_id, Record::Direction::Received, messages[i]);
+
+        m_handler.handleMessage(*this, messages[i]);
     }
-    else if (ret == -1)
+
+    if (!*alive)
+        return false;
+
+    if (peerClosed && (m_localFd != -1))
     {
         closeChannel();
-        m_handler.handleError(*this, errno);
+        m_handler.handlePeerClosed(*this);
         return false;
     }
 
-    assert(ret == Message::MESSAGE_SIZE);
-
-    auto fdCount = message.getFDCount();
-    if (fdCount > 0)
-    {
-        assert(fdCount * sizeof(int) < Message::PAYLOAD_SIZE);
-        auto buffer = message.getPayload<int>();
-        for (uint16_t i = 0; i < fdCount; ++i)
-        {
-            int fd = readFileDescriptor();
-            if (fd == -1)
-            {
-                for (uint16_t j = 0; j < i; ++j)
-                    close(buffer[j]);
-
-                return false;
-            }
+    return (m_localFd != -1) && (ret == static_cast<int>(RECEIVE_BATCH_SIZE));
+}
 
-            buffer[i] = fd;
-        }
-    }
+gboolean Channel::writableCallback(gint /*fd*/, GIOCondition /*condition*/, Channel* channel) noexcept
+{
+    // The channel may be closed (and even destroyed by its handler) when flushSendQueue() fails, so it must not be
+    // accessed anymore after that
+    if (channel->flushSendQueue(false))
+        return G_SOURCE_CONTINUE;
 
-    return true;
+    return G_SOURCE_REMOVE;
 }
 
-bool Channel::writeFileDescriptor(int fd) noexcept
+bool Channel::writeMessage(const Message& message, int flags) noexcept
 {
     assert(m_localFd != -1);
-    if (fd == -1)
-        return false;
-
-    union {
-        cmsghdr header;
-        char buffer[CMSG_SPACE(sizeof(int))];
-    } control = {};
 
+    // The message and all its file descriptors are sent at once, so they cannot be separated on the receiver side
+    iovec iov = {const_cast<Message*>(&message), Message::MESSAGE_SIZE};
     msghdr msg = {};
-    msg.msg_control = control.buffer;
-    msg.msg_controllen = sizeof(control.buffer);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
 
-    cmsghdr* header = CMSG_FIRSTHDR(&msg);
-    header->cmsg_len = CMSG_LEN(sizeof(int));
-    header->cmsg_level = SOL_SOCKET;
-    header->cmsg_type = SCM_RIGHTS;
-    *reinterpret_cast<int*>(CMSG_DATA(header)) = fd;
+    ControlBuffer control = {};
+    auto fdCount = message.getFDCount();
+    if (fdCount > 0)
+    {
+        const size_t fdsSize = fdCount * sizeof(int);
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = CMSG_SPACE(fdsSize);
+
+        cmsghdr* header = CMSG_FIRSTHDR(&msg);
+        header->cmsg_len = CMSG_LEN(fdsSize);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        std::memcpy(CMSG_DATA(header), message.getPayload<int>(), fdsSize);
+    }
 
-    if (sendmsg(m_localFd, &msg, MSG_EOR | MSG_NOSIGNAL) == -1)
+    const ssize_t ret = sendmsg(m_localFd, &msg, MSG_EOR | MSG_NOSIGNAL | flags);
+    if (ret == 0)
     {
-        closeChannel();
-        m_handler.handleError(*this, errno);
+        errno = EPIPE;
         return false;
     }
+    else if (ret == -1)
+        return false;
+
+    assert(ret == Message::MESSAGE_SIZE);
+
+    if (auto* recorder = Recorder::getInstance())
+        recorder->record(m_id, Record::Direction::Sent, message);
 
     return true;
 }
 
-int Channel::readFileDescriptor() noexcept
+void Channel::handleSendFailure(int errnoValue) noexcept
 {
-    assert(m_localFd != -1);
+    closeChannel();
+    if (errnoValue == EPIPE)
+        m_handler.handlePeerClosed(*this);
+    else
+        m_handler.handleError(*this, errnoValue);
+}
 
-    union {
-        cmsghdr header;
-        char buffer[CMSG_SPACE(sizeof(int))];
-    } control = {};
+bool Channel::flushSendQueue(bool blocking) noexcept
+{
+    std::unique_lock<std::mutex> lock(m_sendQueueMutex);
+    const size_t initialDepth = m_sendQueue.size();
+    while (!m_sendQueue.empty())
+    {
+        if (!writeMessage(m_sendQueue.front(), blocking ? 0 : MSG_DONTWAIT))
+        {
+            if (!blocking && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+                break;
 
-    msghdr msg = {};
-    msg.msg_control = control.buffer;
-    msg.msg_controllen = sizeof(control.buffer);
+            const int errnoValue = errno;
+            lock.unlock();
+            handleSendFailure(errnoValue);
+            return false;
+        }
 
-    if (recvmsg(m_localFd, &msg, MSG_WAITALL) == -1)
-    {
-        closeChannel();
-        m_handler.handleError(*this, errno);
-        return -1;
+        closeFileDescriptors(m_sendQueue.front());
+        m_sendQueue.pop_front();
     }
 
-    cmsghdr* header = CMSG_FIRSTHDR(&msg);
-    if (header && (header->cmsg_len == CMSG_LEN(sizeof(int))) && (header->cmsg_level == SOL_SOCKET) &&
-        (header->cmsg_type == SCM_RIGHTS))
-    {
-        int fd = *reinterpret_cast<int*>(CMSG_DATA(header));
-        return fd;
-    }
+    const size_t depth = m_sendQueue.size();
+    if (!depth)
+        destroySource(m_writableSource);
+    lock.unlock();
+
+    if (depth != initialDepth)
+        m_handler.handleSendQueueChanged(*this, depth);
 
-    return -1;
+    return depth > 0;
 }
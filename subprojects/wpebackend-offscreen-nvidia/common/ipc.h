@@ -29,6 +29,9 @@
 #include <glib.h>
 
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 
 namespace IPC
 {
@@ -37,6 +40,7 @@ class Message
   public:
     static constexpr size_t MESSAGE_SIZE = 32;
     static constexpr size_t PAYLOAD_SIZE = MESSAGE_SIZE - 2 * sizeof(uint16_t);
+    static constexpr size_t MAX_FD_COUNT = PAYLOAD_SIZE / sizeof(int);
 
     Message() noexcept = default;
 
@@ -52,11 +56,13 @@ class Message
 
     template <typename T> T* getPayload() noexcept
     {
+        static_assert(sizeof(T) <= PAYLOAD_SIZE, "IPC message payload is too large");
         return reinterpret_cast<T*>(m_payload);
     }
 
     template <typename T> const T* getPayload() const noexcept
     {
+        static_assert(sizeof(T) <= PAYLOAD_SIZE, "IPC message payload is too large");
         return reinterpret_cast<const T*>(m_payload);
     }
 
@@ -76,6 +82,9 @@ class MessageHandler;
 class Channel
 {
   public:
+    // Maximum number of messages pulled from the socket with a single system call
+    static constexpr unsigned int RECEIVE_BATCH_SIZE = 16;
+
     Channel(MessageHandler& handler) noexcept;
     Channel(MessageHandler& handler, int peerFd) noexcept;
 
@@ -86,26 +95,81 @@ class Channel
 
     virtual ~Channel()
     {
+        *m_alive = false;
         closeChannel();
+        if (m_context)
+            g_main_context_unref(m_context);
+    }
+
+    // Messages are dispatched from the default main context unless another one is given here, which can be run by
+    // another thread. It must be called before exchanging messages. Closing the channel from another thread than the
+    // one running the context waits for the dispatch in progress, if any, to finish.
+    bool setMainContext(GMainContext* context) noexcept;
+
+    // How a message is handled in non-blocking mode when it cannot be sent immediately
+    enum class Delivery
+    {
+        // Always queued, even beyond the maximum queue size, as losing it would break the protocol
+        Reliable,
+        // Dropped when the queue is full, the sender must then handle the failure
+        Droppable,
+        // Replaces the queued message with the same code, if any, so that only the latest one is sent. It cannot
+        // carry file descriptors.
+        Coalesced
+    };
+
+    bool sendMessage(const Message& message, Delivery delivery = Delivery::Reliable) noexcept;
+
+    // Dispatches the messages already received from the calling thread, without waiting for the main context to run.
+    // It must not be called while the context is run by another thread.
+    void dispatchPendingMessages() noexcept;
+
+    // Process-wide unique identifier of the channel, used to identify it in IPC recordings
+    uint32_t getId() const noexcept
+    {
+        return m_id;
     }
 
-    bool sendMessage(const Message& message) noexcept;
+    // In non-blocking mode, messages which cannot be sent immediately are queued and flushed from the main loop as
+    // soon as the socket becomes writable, instead of blocking the calling thread. Droppable messages are only queued
+    // up to maxQueueSize messages, see Delivery.
+    // The handler is notified when the queue depth changes and when it reaches highWaterMark, so that the producer can
+    // detect a lagging receiver. A maxQueueSize of 0 restores the default blocking mode.
+    // It must be called before the channel is used from several threads.
+    void setNonBlockingSend(size_t maxQueueSize, size_t highWaterMark) noexcept;
+    size_t getSendQueueDepth() const noexcept;
 
     int detachPeerFd() noexcept;
     void closeChannel() noexcept;
 
   private:
+    const uint32_t m_id;
     int m_localFd = -1;
     int m_peerFd = -1;
     bool configureLocalEndpoint(int localFd) noexcept;
 
-    static gboolean idleCallback(Channel* channel) noexcept;
-    guint m_idleSourceId = 0;
+    GMainContext* m_context = nullptr;
+    GSource* createSocketSource(GIOCondition condition, gboolean (*callback)(gint, GIOCondition, Channel*)) noexcept;
+    void closeChannelNow() noexcept;
+
+    static gboolean socketCallback(gint fd, GIOCondition condition, Channel* channel) noexcept;
+    GSource* m_socketSource = nullptr;
     MessageHandler& m_handler;
 
-    bool readNextMessage(Message& message) noexcept;
-    bool writeFileDescriptor(int fd) noexcept;
-    int readFileDescriptor() noexcept;
+    bool receiveMessages() noexcept;
+    // Cleared on destruction, so that a dispatch in progress can detect that a handler destroyed the channel
+    std::shared_ptr<bool> m_alive = std::make_shared<bool>(true);
+
+    size_t m_maxSendQueueSize = 0;
+    size_t m_sendQueueHighWaterMark = 0;
+    mutable std::mutex m_sendQueueMutex;
+    std::deque<Message> m_sendQueue;
+    GSource* m_writableSource = nullptr;
+
+    static gboolean writableCallback(gint fd, GIOCondition condition, Channel* channel) noexcept;
+    bool writeMessage(const Message& message, int flags) noexcept;
+    void handleSendFailure(int errnoValue) noexcept;
+    bool flushSendQueue(bool blocking) noexcept;
 };
 
 class MessageHandler
@@ -122,5 +186,15 @@ class MessageHandler
     virtual void handlePeerClosed(Channel& /*channel*/) noexcept
     {
     }
+
+    // Only called in non-blocking send mode, possibly from the thread calling Channel::sendMessage()
+    virtual void handleSendQueueChanged(Channel& /*channel*/, size_t /*depth*/) noexcept
+    {
+    }
+
+    // Only called in non-blocking send mode, possibly from the thread calling Channel::sendMessage()
+    virtual void handleSendQueueHighWater(Channel& /*channel*/, size_t /*depth*/) noexcept
+    {
+    }
 };
 } // namespace IPC
@@ -26,10 +26,14 @@
 
 #include "../wpebackend-offscreen-nvidia.h"
 
+#include "../application-side/ConsumerThreadPool.h"
+#include "../application-side/EGLDeviceSelector.h"
 #include "../application-side/RendererHost.h"
 #include "../application-side/ViewBackend.h"
 #include "../wpewebprocess-side/RendererBackendEGL.h"
 #include "../wpewebprocess-side/RendererBackendEGLTarget.h"
+#include "EGLDevice.h"
+#include "ipc-thread.h"
 
 #include <cstring>
 
@@ -95,7 +99,16 @@ extern "C"
 __attribute__((visibility("default"))) wpe_offscreen_nvidia_view_backend* wpe_offscreen_nvidia_view_backend_create(
     wpe_offscreen_nvidia_on_frame_available_callback cb, void* user_data, uint32_t width, uint32_t height)
 {
-    ViewBackend::ViewParams viewParams = {cb, user_data, width, height};
+    ViewBackend::ViewParams viewParams = {cb, nullptr, user_data, width, height};
+    wpe_view_backend_create_with_backend_interface(ViewBackend::getWPEInterface(), &viewParams);
+    return static_cast<wpe_offscreen_nvidia_view_backend*>(viewParams.userData);
+}
+
+__attribute__((visibility("default"))) wpe_offscreen_nvidia_view_backend*
+wpe_offscreen_nvidia_view_backend_create_with_frame_info(wpe_offscreen_nvidia_on_frame_info_available_callback cb,
+                                                         void* user_data, uint32_t width, uint32_t height)
+{
+    ViewBackend::ViewParams viewParams = {nullptr, cb, user_data, width, height};
     wpe_view_backend_create_with_backend_interface(ViewBackend::getWPEInterface(), &viewParams);
     return static_cast<wpe_offscreen_nvidia_view_backend*>(viewParams.userData);
 }
@@ -111,3 +124,110 @@ __attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_di
 {
     static_cast<ViewBackend*>(offscreen_backend)->frameComplete();
 }
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_dispatch_frame_complete_with_sync(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, EGLSync release_sync)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->frameComplete(release_sync);
+}
+
+__attribute__((visibility("default"))) EGLDisplay wpe_offscreen_nvidia_view_backend_get_egl_display(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend)
+{
+    return static_cast<ViewBackend*>(offscreen_backend)->getEGLDisplay();
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_ipc_context(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, GMainContext* context)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setIPCContext(context);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_presentation_mode(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, wpe_offscreen_nvidia_presentation_mode mode,
+    uint32_t fifo_depth)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setPresentationMode(mode, fifo_depth);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_frame_pixels_callback(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, wpe_offscreen_nvidia_on_frame_pixels_available_callback cb,
+    void* user_data)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setPixelsCallback(cb, user_data);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_damage_tracking(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, bool enabled)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setDamageTracking(enabled);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_skip_unchanged_frames(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, bool enabled)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setSkipUnchangedFrames(enabled);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_target_fps(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, uint32_t fps)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setTargetFPS(fps);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_visible(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, bool visible)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setActivityState(wpe_view_activity_state_visible, visible);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_focused(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, bool focused)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setActivityState(wpe_view_activity_state_focused, focused);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_in_window(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, bool in_window)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setActivityState(wpe_view_activity_state_in_window, in_window);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_set_size_buckets(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, const wpe_offscreen_nvidia_size* sizes, uint32_t count)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->setSizeBuckets(sizes, count);
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_view_backend_resize(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend, uint32_t width, uint32_t height)
+{
+    static_cast<ViewBackend*>(offscreen_backend)->resize(width, height);
+}
+
+__attribute__((visibility("default"))) GMainContext* wpe_offscreen_nvidia_get_ipc_thread_context()
+{
+    return IPC::IOThread::getMainContext();
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_set_consumer_thread_count(uint32_t count)
+{
+    ConsumerThreadPool::setThreadCount(count);
+}
+
+__attribute__((visibility("default"))) int32_t wpe_offscreen_nvidia_get_egl_device_count()
+{
+    return EGLDevice::getDeviceCount();
+}
+
+__attribute__((visibility("default"))) void wpe_offscreen_nvidia_set_egl_device_policy(
+    wpe_offscreen_nvidia_egl_device_policy policy, int32_t device)
+{
+    EGLDeviceSelector::setPolicy(policy, device);
+}
+
+__attribute__((visibility("default"))) int32_t wpe_offscreen_nvidia_view_backend_get_egl_device(
+    wpe_offscreen_nvidia_view_backend* offscreen_backend)
+{
+    return static_cast<ViewBackend*>(offscreen_backend)->getEGLDevice();
+}
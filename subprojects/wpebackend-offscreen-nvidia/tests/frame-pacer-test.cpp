@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../application-side/FramePacer.h"
+
+#include <glib.h>
+
+namespace
+{
+constexpr uint32_t TARGET_FPS = 60;
+constexpr int64_t FRAME_INTERVAL = G_USEC_PER_SEC / TARGET_FPS;
+
+// Starts far from 0, which the pacer uses as "no frame scheduled yet"
+int64_t s_now = 0;
+int64_t fakeClock()
+{
+    return s_now;
+}
+
+void resetClock() noexcept
+{
+    s_now = 1000 * G_USEC_PER_SEC;
+}
+
+// Waits for the delay given by the pacer, plus the latency of the dispatch, and notifies the frame as displayed
+int64_t displayNextFrame(FramePacer& pacer, int64_t dispatchLatency = 0) noexcept
+{
+    s_now += pacer.getFrameDelay() + dispatchLatency;
+    pacer.frameDisplayed();
+    return s_now;
+}
+
+void testDisabled()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    g_assert_cmpuint(pacer.getTargetFPS(), ==, 0);
+    pacer.frameDisplayed();
+    g_assert_cmpint(pacer.getFrameDelay(), ==, 0);
+
+    pacer.setTargetFPS(TARGET_FPS);
+    pacer.frameDisplayed();
+    g_assert_cmpint(pacer.getFrameDelay(), ==, FRAME_INTERVAL);
+
+    // Disabling the pacing releases the pending frame right away
+    pacer.setTargetFPS(0);
+    g_assert_cmpint(pacer.getFrameDelay(), ==, 0);
+}
+
+void testGridAlignment()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    pacer.setTargetFPS(TARGET_FPS);
+
+    // The dispatch latency varies from frame to frame, but the frames stay aligned on the grid started by the first
+    // one instead of drifting by the accumulated latency
+    const int64_t startTime = displayNextFrame(pacer);
+    constexpr int frameCount = 10 * TARGET_FPS;
+    for (int i = 1; i <= frameCount; ++i)
+    {
+        const int64_t dispatchLatency = (i % 4) * 1000;
+        const int64_t displayTime = displayNextFrame(pacer, dispatchLatency);
+        g_assert_cmpint(displayTime, ==, startTime + i * FRAME_INTERVAL + dispatchLatency);
+        g_assert_cmpint(pacer.getFrameDelay(), ==, FRAME_INTERVAL - dispatchLatency);
+    }
+}
+
+void testFIFOBacklog()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    pacer.setTargetFPS(TARGET_FPS);
+
+    // With a full FIFO, frames are ready as soon as the previous one is displayed: they are still released one per
+    // interval, without any burst
+    constexpr int fifoDepth = 4;
+    int64_t previousTime = displayNextFrame(pacer);
+    for (int i = 0; i < 10 * fifoDepth; ++i)
+    {
+        g_assert_cmpint(pacer.getFrameDelay(), ==, FRAME_INTERVAL);
+        const int64_t displayTime = displayNextFrame(pacer);
+        g_assert_cmpint(displayTime - previousTime, ==, FRAME_INTERVAL);
+        previousTime = displayTime;
+    }
+}
+
+void testCatchUp()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    pacer.setTargetFPS(TARGET_FPS);
+    const int64_t startTime = displayNextFrame(pacer);
+
+    // A frame late by less than an interval keeps the grid, the next one is released earlier to catch up
+    const int64_t lateness = FRAME_INTERVAL / 2;
+    g_assert_cmpint(displayNextFrame(pacer, lateness), ==, startTime + FRAME_INTERVAL + lateness);
+    g_assert_cmpint(pacer.getFrameDelay(), ==, FRAME_INTERVAL - lateness);
+    g_assert_cmpint(displayNextFrame(pacer), ==, startTime + 2 * FRAME_INTERVAL);
+}
+
+void testStall()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    pacer.setTargetFPS(TARGET_FPS);
+    displayNextFrame(pacer);
+
+    // After a stall longer than an interval (slow page, idle view), the grid restarts from the late frame instead of
+    // releasing the missed frames in a burst
+    const int64_t stall = 5 * FRAME_INTERVAL + 1234;
+    const int64_t restartTime = displayNextFrame(pacer, stall);
+    for (int i = 1; i <= 5; ++i)
+    {
+        g_assert_cmpint(pacer.getFrameDelay(), ==, FRAME_INTERVAL);
+        g_assert_cmpint(displayNextFrame(pacer), ==, restartTime + i * FRAME_INTERVAL);
+    }
+}
+
+void testTargetChange()
+{
+    resetClock();
+    FramePacer pacer(fakeClock);
+    pacer.setTargetFPS(TARGET_FPS);
+    displayNextFrame(pacer);
+
+    // The new rate applies from the next frame, which is released right away
+    constexpr uint32_t newTargetFPS = 30;
+    pacer.setTargetFPS(newTargetFPS);
+    g_assert_cmpint(pacer.getFrameDelay(), ==, 0);
+    displayNextFrame(pacer);
+    g_assert_cmpint(pacer.getFrameDelay(), ==, G_USEC_PER_SEC / newTargetFPS);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, nullptr);
+    g_test_add_func("/frame-pacer/disabled", testDisabled);
+    g_test_add_func("/frame-pacer/grid-alignment", testGridAlignment);
+    g_test_add_func("/frame-pacer/fifo-backlog", testFIFOBacklog);
+    g_test_add_func("/frame-pacer/catch-up", testCatchUp);
+    g_test_add_func("/frame-pacer/stall", testStall);
+    g_test_add_func("/frame-pacer/target-change", testTargetChange);
+    return g_test_run();
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../common/ipc-messages.h"
+
+#include <glib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <unistd.h>
+
+namespace
+{
+// The channel must not wake the main loop up while no message is received, only the timeout ending the interval does
+constexpr guint IDLE_INTERVAL_MS = 200;
+constexpr unsigned int MAX_IDLE_ITERATIONS = 2;
+
+class CountingHandler final : public IPC::MessageHandler
+{
+  public:
+    unsigned int messageCount = 0;
+
+    void handleMessage(IPC::Channel& /*channel*/, const IPC::Message& /*message*/) noexcept override
+    {
+        ++messageCount;
+    }
+};
+
+class RecordingHandler final : public IPC::MessageHandler
+{
+  public:
+    unsigned int stateCount = 0;
+    unsigned int frameCount = 0;
+    uint64_t lastFrameId = 0;
+
+    void handleMessage(IPC::Channel& /*channel*/, const IPC::Message& message) noexcept override
+    {
+        if (message.getCode() == IPC::EGLStreamState::MESSAGE_CODE)
+            ++stateCount;
+        else if (message.getCode() == IPC::EGLStreamFrame::MESSAGE_CODE)
+        {
+            ++frameCount;
+            lastFrameId = static_cast<const IPC::EGLStreamFrame&>(message).getFrameId();
+        }
+    }
+};
+
+class DestroyingHandler final : public IPC::MessageHandler
+{
+  public:
+    IPC::Channel* channel = nullptr;
+    unsigned int messageCount = 0;
+
+    void handleMessage(IPC::Channel& /*channel*/, const IPC::Message& /*message*/) noexcept override
+    {
+        ++messageCount;
+        delete std::exchange(channel, nullptr);
+    }
+};
+
+unsigned int countIterations(GMainContext* context, guint intervalMs) noexcept
+{
+    bool done = false;
+    GSource* timeout = g_timeout_source_new(intervalMs);
+    g_source_set_callback(
+        timeout,
+        +[](gpointer data) -> gboolean {
+            *static_cast<bool*>(data) = true;
+            return G_SOURCE_REMOVE;
+        },
+        &done, nullptr);
+    g_source_attach(timeout, context);
+    g_source_unref(timeout);
+
+    unsigned int iterations = 0;
+    while (!done)
+    {
+        g_main_context_iteration(context, TRUE);
+        ++iterations;
+    }
+
+    return iterations;
+}
+
+void testIdleChannel()
+{
+    GMainContext* context = g_main_context_new();
+    CountingHandler handler;
+    {
+        IPC::Channel channel(handler);
+        g_assert_true(channel.setMainContext(context));
+
+        // The peer end stays open without sending anything
+        const int peerFd = channel.detachPeerFd();
+        g_assert_cmpint(peerFd, !=, -1);
+
+        g_assert_cmpuint(countIterations(context, IDLE_INTERVAL_MS), <=, MAX_IDLE_ITERATIONS);
+        g_assert_cmpuint(handler.messageCount, ==, 0);
+        close(peerFd);
+    }
+    g_main_context_unref(context);
+}
+
+void testPendingMessagesDrained()
+{
+    GMainContext* context = g_main_context_new();
+    CountingHandler handler;
+    CountingHandler peerHandler;
+    {
+        IPC::Channel channel(handler);
+        g_assert_true(channel.setMainContext(context));
+        IPC::Channel peer(peerHandler, channel.detachPeerFd());
+
+        // Several receive batches are pending, all of them are dispatched from a single wakeup
+        constexpr unsigned int messageCount = 3 * IPC::Channel::RECEIVE_BATCH_SIZE + 1;
+        for (unsigned int i = 0; i < messageCount; ++i)
+            g_assert_true(peer.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Connected)));
+
+        g_assert_true(g_main_context_iteration(context, FALSE));
+        g_assert_cmpuint(handler.messageCount, ==, messageCount);
+        g_assert_false(g_main_context_iteration(context, FALSE));
+    }
+    g_main_context_unref(context);
+}
+
+void testFullQueueDelivery()
+{
+    GMainContext* context = g_main_context_new();
+    GMainContext* peerContext = g_main_context_new();
+    RecordingHandler handler;
+    CountingHandler peerHandler;
+    {
+        IPC::Channel channel(handler);
+        g_assert_true(channel.setMainContext(context));
+        IPC::Channel peer(peerHandler, channel.detachPeerFd());
+        g_assert_true(peer.setMainContext(peerContext));
+
+        constexpr size_t maxQueueSize = 4;
+        peer.setNonBlockingSend(maxQueueSize, maxQueueSize);
+
+        // Fill the socket buffer, then the queue, after which droppable messages are rejected
+        unsigned int sentStates = 0;
+        while (peer.getSendQueueDepth() < maxQueueSize)
+        {
+            g_assert_true(peer.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Connected)));
+            ++sentStates;
+        }
+        g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "*queue is full*");
+        g_assert_false(peer.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Connected),
+                                        IPC::Channel::Delivery::Droppable));
+        g_test_assert_expected_messages();
+        g_assert_cmpuint(peer.getSendQueueDepth(), ==, maxQueueSize);
+
+        // Reliable messages are still queued beyond the maximum size
+        g_assert_true(peer.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Error)));
+        ++sentStates;
+        g_assert_cmpuint(peer.getSendQueueDepth(), ==, maxQueueSize + 1);
+
+        // Coalesced messages replace each other in the queue
+        constexpr uint64_t frameCount = 3 * maxQueueSize;
+        for (uint64_t frameId = 1; frameId <= frameCount; ++frameId)
+            g_assert_true(peer.sendMessage(IPC::EGLStreamFrame(frameId), IPC::Channel::Delivery::Coalesced));
+        g_assert_cmpuint(peer.getSendQueueDepth(), ==, maxQueueSize + 2);
+
+        while (peer.getSendQueueDepth())
+        {
+            g_main_context_iteration(context, FALSE);
+            g_main_context_iteration(peerContext, FALSE);
+        }
+        while (g_main_context_iteration(context, FALSE))
+            ;
+
+        g_assert_cmpuint(handler.stateCount, ==, sentStates);
+        g_assert_cmpuint(handler.frameCount, ==, 1);
+        g_assert_cmpuint(handler.lastFrameId, ==, frameCount);
+    }
+    g_main_context_unref(peerContext);
+    g_main_context_unref(context);
+}
+
+void testDestroyedFromHandler()
+{
+    GMainContext* context = g_main_context_new();
+    DestroyingHandler handler;
+    CountingHandler peerHandler;
+    handler.channel = new IPC::Channel(handler);
+    g_assert_true(handler.channel->setMainContext(context));
+    {
+        IPC::Channel peer(peerHandler, handler.channel->detachPeerFd());
+
+        // The channel is destroyed by the first message, the following ones of the same batch are discarded
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            g_assert_true(peer.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Connected)));
+            g_assert_true(peer.sendMessage(IPC::EGLStreamFileDescriptor(STDIN_FILENO)));
+        }
+
+        g_assert_true(g_main_context_iteration(context, FALSE));
+        g_assert_null(handler.channel);
+        g_assert_cmpuint(handler.messageCount, ==, 1);
+    }
+    g_main_context_unref(context);
+}
+
+void testCloseFromUnrunContext()
+{
+    GMainContext* context = g_main_context_new();
+    CountingHandler handler;
+    auto* channel = new IPC::Channel(handler);
+    g_assert_true(channel->setMainContext(context));
+
+    // The context is owned by another thread, which stops owning it without ever running it
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool acquired = false;
+    std::thread owner([&] {
+        g_assert_true(g_main_context_acquire(context));
+        std::unique_lock<std::mutex> lock(mutex);
+        acquired = true;
+        condition.notify_all();
+        lock.unlock();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_INTERVAL_MS));
+        g_main_context_release(context);
+    });
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&acquired] { return acquired; });
+    lock.unlock();
+
+    delete channel;
+    owner.join();
+    g_main_context_unref(context);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    g_test_init(&argc, &argv, nullptr);
+    g_test_add_func("/ipc/channel/idle-wakeups", testIdleChannel);
+    g_test_add_func("/ipc/channel/pending-messages-drained", testPendingMessagesDrained);
+    g_test_add_func("/ipc/channel/full-queue-delivery", testFullQueueDelivery);
+    g_test_add_func("/ipc/channel/destroyed-from-handler", testDestroyedFromHandler);
+    g_test_add_func("/ipc/channel/close-from-unrun-context", testCloseFromUnrunContext);
+    return g_test_run();
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2023 Igalia S.L.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../application-side/ViewBackend.h"
+#include "../common/ipc-recorder.h"
+#include "../wpewebprocess-side/RendererBackendEGLTarget.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include <sys/socket.h>
+
+namespace
+{
+const char* getMessageName(uint16_t code) noexcept
+{
+    switch (code)
+    {
+    case IPC::ProtocolHandshake::MESSAGE_CODE:
+        return "ProtocolHandshake";
+    case IPC::EGLStreamFileDescriptor::MESSAGE_CODE:
+        return "EGLStreamFileDescriptor";
+    case IPC::EGLStreamState::MESSAGE_CODE:
+        return "EGLStreamState";
+    case IPC::FrameMetadataRingFileDescriptors::MESSAGE_CODE:
+        return "FrameMetadataRingFileDescriptors";
+    case IPC::DMABufBuffer::MESSAGE_CODE:
+        return "DMABufBuffer";
+    case IPC::DMABufFrame::MESSAGE_CODE:
+        return "DMABufFrame";
+    case IPC::DMABufRelease::MESSAGE_CODE:
+        return "DMABufRelease";
+    case IPC::SurfaceSizeBuckets::MESSAGE_CODE:
+        return "SurfaceSizeBuckets";
+    case IPC::EGLDeviceSelection::MESSAGE_CODE:
+        return "EGLDeviceSelection";
+    case IPC::EGLStreamFrame::MESSAGE_CODE:
+        return "EGLStreamFrame";
+    case IPC::DMABufReleaseFence::MESSAGE_CODE:
+        return "DMABufReleaseFence";
+    default:
+        return "Unknown";
+    }
+}
+
+void printUsage(const char* program) noexcept
+{
+    std::fprintf(stderr,
+                 "Usage: %s --list FILE\n"
+                 "       %s --dump FILE\n"
+                 "       %s --channel ID --handler view-backend|egl-target [--max-speed] FILE\n\n"
+                 "Recordings are produced by running the application with %s=<path prefix>\n",
+                 program, program, program, IPC::Recorder::ENV_VARIABLE);
+}
+
+void listChannels(const IPC::Replayer& replayer) noexcept
+{
+    std::map<uint32_t, std::pair<size_t, size_t>> channels;
+    for (const IPC::Record& record : replayer.getRecords())
+    {
+        auto& counts = channels[record.channelId];
+        if (record.direction == IPC::Record::Direction::Sent)
+            ++counts.first;
+        else
+            ++counts.second;
+    }
+
+    for (const auto& [channelId, counts] : channels)
+        std::printf("channel %u: %zu sent, %zu received\n", channelId, counts.first, counts.second);
+}
+
+void dumpRecords(const IPC::Replayer& replayer) noexcept
+{
+    const auto& records = replayer.getRecords();
+    const int64_t firstTimestamp = records.empty() ? 0 : records.front().timestamp;
+    for (const IPC::Record& record : records)
+    {
+        std::printf("%12.6f channel %u %s %s (code %u, %u fds)\n",
+                    static_cast<double>(record.timestamp - firstTimestamp) / G_USEC_PER_SEC, record.channelId,
+                    (record.direction == IPC::Record::Direction::Sent) ? "sent" : "received",
+                    getMessageName(record.message.getCode()), record.message.getCode(),
+                    record.message.getFDCount());
+    }
+}
+
+IPC::Replayer::Statistics replayIntoViewBackend(IPC::Replayer& replayer, uint32_t channelId, bool maxSpeed) noexcept
+{
+    ViewBackend::ViewParams viewParams = {nullptr, nullptr, nullptr, 1, 1};
+    wpe_view_backend* wpeBackend =
+        wpe_view_backend_create_with_backend_interface(ViewBackend::getWPEInterface(), &viewParams);
+    wpe_view_backend_initialize(wpeBackend);
+
+    auto statistics =
+        replayer.replay(channelId, wpe_view_backend_get_renderer_host_fd(wpeBackend), maxSpeed, nullptr);
+
+    wpe_view_backend_destroy(wpeBackend);
+    return statistics;
+}
+
+IPC::Replayer::Statistics replayIntoEGLTarget(IPC::Replayer& replayer, uint32_t channelId, bool maxSpeed) noexcept
+{
+    auto* targetInterface = RendererBackendEGLTarget::getWPEInterface();
+
+    int sockets[2] = {};
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0)
+        return {};
+
+    void* target = targetInterface->create(nullptr, sockets[0]);
+    auto statistics = replayer.replay(channelId, sockets[1], maxSpeed, nullptr);
+    targetInterface->destroy(target);
+    return statistics;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const char* path = nullptr;
+    const char* handler = nullptr;
+    bool list = false;
+    bool dump = false;
+    bool maxSpeed = false;
+    uint32_t channelId = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--list") == 0)
+            list = true;
+        else if (std::strcmp(argv[i], "--dump") == 0)
+            dump = true;
+        else if (std::strcmp(argv[i], "--max-speed") == 0)
+            maxSpeed = true;
+        else if ((std::strcmp(argv[i], "--channel") == 0) && (i + 1 < argc))
+            channelId = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if ((std::strcmp(argv[i], "--handler") == 0) && (i + 1 < argc))
+            handler = argv[++i];
+        else
+            path = argv[i];
+    }
+
+    if (!path || (!list && !dump && (!channelId || !handler)))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto replayer = IPC::Replayer::load(path);
+    if (!replayer)
+    {
+        std::fprintf(stderr, "Cannot load the IPC recording %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    if (list)
+    {
+        listChannels(*replayer);
+        return EXIT_SUCCESS;
+    }
+
+    if (dump)
+    {
+        dumpRecords(*replayer);
+        return EXIT_SUCCESS;
+    }
+
+    IPC::Replayer::Statistics statistics = {};
+    if (std::strcmp(handler, "view-backend") == 0)
+        statistics = replayIntoViewBackend(*replayer, channelId, maxSpeed);
+    else if (std::strcmp(handler, "egl-target") == 0)
+        statistics = replayIntoEGLTarget(*replayer, channelId, maxSpeed);
+    else
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const double seconds = static_cast<double>(statistics.duration) / G_USEC_PER_SEC;
+    std::printf("%zu messages replayed in %.3f ms (%.0f messages/s), %zu replies\n", statistics.messageCount,
+                seconds * 1000, (seconds > 0) ? (statistics.messageCount / seconds) : 0.0, statistics.replyCount);
+    return EXIT_SUCCESS;
+}
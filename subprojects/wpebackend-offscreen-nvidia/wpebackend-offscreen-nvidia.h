@@ -34,7 +34,17 @@ extern "C"
 {
 #endif
 
+    struct _GMainContext;
     struct wpe_offscreen_nvidia_view_backend;
+
+    enum wpe_offscreen_nvidia_presentation_mode
+    {
+        // Only the latest rendered frame is kept, older ones are dropped: lowest latency
+        WPE_OFFSCREEN_NVIDIA_PRESENTATION_MODE_MAILBOX,
+        // Rendered frames are queued and all delivered in order: highest throughput
+        WPE_OFFSCREEN_NVIDIA_PRESENTATION_MODE_FIFO
+    };
+
     typedef void (*wpe_offscreen_nvidia_on_frame_available_callback)(
         struct wpe_offscreen_nvidia_view_backend* offscreen_backend, EGLImage frame, void* user_data);
 
@@ -43,11 +53,194 @@ extern "C"
     struct wpe_offscreen_nvidia_view_backend* wpe_offscreen_nvidia_view_backend_create(
         wpe_offscreen_nvidia_on_frame_available_callback cb, void* user_data, uint32_t width, uint32_t height);
 
+    // Rectangle in pixels, with the origin at the bottom-left corner of the frame image
+    struct wpe_offscreen_nvidia_rect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Frames are backed by a small set of EGLImages which are reused across frames. The slot index identifies the
+    // EGLImage within this set: as long as slot_generation doesn't change for a given slot, its image is the same, so
+    // the resources derived from it (GL textures, encoder registrations...) can be cached per slot.
+    // When not EGL_NO_SYNC, acquire_sync is signaled once the WPEWebProcess rendering into the image is complete, and
+    // must be waited for (eglWaitSync) before reading the image. It is owned by the view backend. The image given to
+    // the wpe_offscreen_nvidia_on_frame_available_callback is always ready to be read.
+    // The image may be larger than the view when size buckets are used, the content then occupies its bottom-left
+    // width x height area.
+    // The frame_id is a sequence number given by the WPEWebProcess to each rendered frame, rendered_time_us and
+    // acquire_time_us are the g_get_monotonic_time() values at which the frame was rendered by the WPEWebProcess and
+    // acquired by the view backend, and dropped_frames counts the frames skipped since the previous delivered one
+    // (mailbox presentation mode). Each of them is 0 when unknown.
+    // When damage tracking is enabled, damage_rects lists the regions of the content which changed since the previous
+    // frame (none if damage_rect_count is 0). It is NULL otherwise, the whole frame must then be considered as damaged.
+    // The rectangles are only valid during the callback, they must be copied to be used afterwards.
+    // The skipped_frames counts the unchanged frames skipped since the previous delivered one, they are not counted in
+    // dropped_frames.
+    struct wpe_offscreen_nvidia_frame_info
+    {
+        EGLImage image;
+        uint32_t slot;
+        uint32_t slot_generation;
+        EGLSync acquire_sync;
+        uint32_t width;
+        uint32_t height;
+        uint64_t frame_id;
+        int64_t rendered_time_us;
+        int64_t acquire_time_us;
+        uint32_t dropped_frames;
+        const struct wpe_offscreen_nvidia_rect* damage_rects;
+        uint32_t damage_rect_count;
+        uint32_t skipped_frames;
+    };
+    typedef void (*wpe_offscreen_nvidia_on_frame_info_available_callback)(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+        const struct wpe_offscreen_nvidia_frame_info* frame_info, void* user_data);
+
+    // Same as wpe_offscreen_nvidia_view_backend_create, but the callback receives the frame slot information
+    struct wpe_offscreen_nvidia_view_backend* wpe_offscreen_nvidia_view_backend_create_with_frame_info(
+        wpe_offscreen_nvidia_on_frame_info_available_callback cb, void* user_data, uint32_t width, uint32_t height);
+
     struct wpe_view_backend* wpe_offscreen_nvidia_view_backend_get_wpe_backend(
         struct wpe_offscreen_nvidia_view_backend* offscreen_backend);
     void wpe_offscreen_nvidia_view_backend_dispatch_frame_complete(
         struct wpe_offscreen_nvidia_view_backend* offscreen_backend);
 
+    // Same as wpe_offscreen_nvidia_view_backend_dispatch_frame_complete, but the frame image is only reused by the
+    // WPEWebProcess once release_sync is signaled, instead of waiting for the application rendering on the CPU side.
+    // The release_sync must be a fence sync (EGL_SYNC_FENCE) created on the display returned by
+    // wpe_offscreen_nvidia_view_backend_get_egl_display, after the commands reading the frame image. Its ownership is
+    // transferred to the view backend.
+    void wpe_offscreen_nvidia_view_backend_dispatch_frame_complete_with_sync(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend, EGLSync release_sync);
+
+    // Frame pixels copied to CPU memory, as RGBA with 8 bits per component. Rows are stored bottom-up, as returned by
+    // glReadPixels. The frame_number counts the frames read back since the view backend initialization, including the
+    // ones skipped while the previous copies are still pending, which leave gaps between the delivered frame numbers.
+    struct wpe_offscreen_nvidia_frame_pixels
+    {
+        const void* data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint64_t frame_number;
+    };
+    typedef void (*wpe_offscreen_nvidia_on_frame_pixels_available_callback)(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+        const struct wpe_offscreen_nvidia_frame_pixels* frame_pixels, void* user_data);
+
+    // Enables the asynchronous readback of every frame into CPU memory, without stalling the rendering pipeline: the
+    // pixels of a frame are delivered one or two frames later. The callback is called from an internal thread, and the
+    // pixels are only valid during the call. If no frame callback was given at creation, frames are given back to the
+    // WPEWebProcess as soon as they are copied. The view backend must not be destroyed from the callback: such a
+    // destruction is deferred to the default main context, and frames may still be delivered until then.
+    // It must be called before the view backend initialization (before creating the web view).
+    void wpe_offscreen_nvidia_view_backend_set_frame_pixels_callback(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+        wpe_offscreen_nvidia_on_frame_pixels_available_callback cb, void* user_data);
+
+    // Enables the computation of the damaged regions of every frame, given in the frame info. The frames are compared
+    // on the GPU from an internal thread before being delivered, which adds a small latency. It needs a view backend
+    // created with a frame info callback, and must be called before the view backend initialization (before creating
+    // the web view).
+    void wpe_offscreen_nvidia_view_backend_set_damage_tracking(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend, bool enabled);
+
+    // Frames identical to the previous one are given back to the WPEWebProcess without being delivered, which saves
+    // the application processing of pages continuously rendering the same content. The frames are reduced on the GPU to
+    // per-block hashes compared with the ones of the previous frame, from an internal thread and without blocking it,
+    // which adds a small latency. With the damage tracking enabled, the damage is used instead.
+    // It must be called before the view backend initialization (before creating the web view).
+    void wpe_offscreen_nvidia_view_backend_set_skip_unchanged_frames(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend, bool enabled);
+
+    // Limits the rate at which the WPEWebProcess renders frames to the given number of frames per second, by delaying
+    // the frame displayed notifications given to WebKit (0 to render as fast as frames are completed, by default).
+    // It can be called at any time, from the thread delivering the frames.
+    void wpe_offscreen_nvidia_view_backend_set_target_fps(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                          uint32_t fps);
+
+    // Update the activity state of the view, which is visible, focused and in a window by default. WebKit stops
+    // compositing hidden views, and no frame is delivered until the view is visible again. They can be called at any
+    // time, from the thread delivering the frames.
+    void wpe_offscreen_nvidia_view_backend_set_visible(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                       bool visible);
+    void wpe_offscreen_nvidia_view_backend_set_focused(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                       bool focused);
+    void wpe_offscreen_nvidia_view_backend_set_in_window(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                         bool in_window);
+
+    struct wpe_offscreen_nvidia_size
+    {
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Pre-defines up to 6 surface sizes for the WPEWebProcess frames: when the view size fits into one of them, the
+    // smallest one is allocated instead of the exact view size, so that resizing within a bucket doesn't reallocate
+    // the surface. It must be called before the view backend initialization (before creating the web view).
+    void wpe_offscreen_nvidia_view_backend_set_size_buckets(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                            const struct wpe_offscreen_nvidia_size* sizes,
+                                                            uint32_t count);
+
+    // Resizes the view, keeping the web page and the WPEWebProcess alive. The WPEWebProcess surface is renegotiated
+    // over the existing IPC channel when the new size doesn't fit into the current one.
+    void wpe_offscreen_nvidia_view_backend_resize(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                  uint32_t width, uint32_t height);
+
+    // Returns the EGLDisplay owning the frame images and syncs (EGL_NO_DISPLAY before the view backend initialization)
+    EGLDisplay wpe_offscreen_nvidia_view_backend_get_egl_display(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend);
+
+    // By default, the IPC messages exchanged with the WPEWebProcess are dispatched from the default GMainContext. This
+    // allows to dispatch them from another context (NULL meaning the default one), so that the EGLStream handshake
+    // doesn't depend on the application main loop load. Frames are still delivered from the default GMainContext.
+    // It must be called before the view backend initialization (before creating the web view).
+    void wpe_offscreen_nvidia_view_backend_set_ipc_context(struct wpe_offscreen_nvidia_view_backend* offscreen_backend,
+                                                           struct _GMainContext* context);
+
+    // Selects how rendered frames are handed over to the application (FIFO with a depth of 1 by default). The
+    // fifo_depth is the number of frames the WPEWebProcess can render ahead and is ignored in mailbox mode.
+    // It must be called before the view backend initialization (before creating the web view).
+    void wpe_offscreen_nvidia_view_backend_set_presentation_mode(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend, enum wpe_offscreen_nvidia_presentation_mode mode,
+        uint32_t fifo_depth);
+
+    // Returns the GMainContext of an internal thread dedicated to IPC, started on first call
+    struct _GMainContext* wpe_offscreen_nvidia_get_ipc_thread_context(void);
+
+    // Frames of all the views are consumed by a shared pool of internal threads, half as many as the CPU cores by
+    // default (0). It must be called before the first view backend initialization.
+    void wpe_offscreen_nvidia_set_consumer_thread_count(uint32_t count);
+
+    enum wpe_offscreen_nvidia_egl_device_policy
+    {
+        // The EGL implementation picks the device of the default display
+        WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_DEFAULT,
+        // All WPEWebProcesses use the given device
+        WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_FIXED,
+        // WPEWebProcesses are spread over all the devices in turn
+        WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_ROUND_ROBIN,
+        // Each WPEWebProcess uses the device with the fewest WPEWebProcesses and views
+        WPE_OFFSCREEN_NVIDIA_EGL_DEVICE_POLICY_LEAST_LOADED
+    };
+
+    // Returns the number of EGL devices (GPUs) which can be selected, 0 if EGL_EXT_device_enumeration or
+    // EGL_EXT_platform_device are not supported
+    int32_t wpe_offscreen_nvidia_get_egl_device_count(void);
+
+    // Selects the EGL device of the WPEWebProcesses launched from now on, the device index being only used by the fixed
+    // policy. All the views rendered by a WPEWebProcess use its device, on both sides, so a view can be placed on a
+    // given device by setting the fixed policy before creating its web view in a new WPEWebProcess.
+    void wpe_offscreen_nvidia_set_egl_device_policy(enum wpe_offscreen_nvidia_egl_device_policy policy, int32_t device);
+
+    // Returns the EGL device index used by the view (-1 for the default display). The view backend switches its
+    // EGLDisplay to this device before delivering the first frame.
+    int32_t wpe_offscreen_nvidia_view_backend_get_egl_device(
+        struct wpe_offscreen_nvidia_view_backend* offscreen_backend);
+
 #ifdef __cplusplus
 }
 #endif
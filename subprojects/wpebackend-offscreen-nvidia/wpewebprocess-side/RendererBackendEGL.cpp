@@ -44,9 +44,26 @@ wpe_renderer_backend_egl_interface* RendererBackendEGL::getWPEInterface() noexce
 
 RendererBackendEGL::RendererBackendEGL(int rendererHostClientFd) noexcept : m_ipcChannel(*this, rendererHostClientFd)
 {
+    // The device selection is sent before the WPEWebProcess is launched, and must be known before WPEWebProcess
+    // queries the native display, right after this creation
+    m_ipcChannel.dispatchPendingMessages();
 }
 
-void RendererBackendEGL::handleMessage(IPC::Channel& /*channel*/, const IPC::Message& /*message*/) noexcept
+void RendererBackendEGL::handleMessage(IPC::Channel& /*channel*/, const IPC::Message& message) noexcept
 {
     // Messages received on WPEWebProcess side from RendererHostClient on application process side
+    if (!IPC::RendererBackendEGLMessages::dispatch(*this, message))
+        g_debug("Unknown IPC message %u received on RendererBackendEGL side", message.getCode());
+}
+
+void RendererBackendEGL::handle(const IPC::EGLDeviceSelection& message) noexcept
+{
+    const int32_t index = message.getIndex();
+    if ((index != EGLDevice::DEFAULT_DEVICE) && !EGLDevice::getDevice(index))
+    {
+        g_warning("EGL device %d is not available on RendererBackendEGL side, the default one is used", index);
+        return;
+    }
+
+    m_deviceIndex = index;
 }
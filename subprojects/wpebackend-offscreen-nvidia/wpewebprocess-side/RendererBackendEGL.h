@@ -26,7 +26,8 @@
 
 #pragma once
 
-#include "../common/ipc.h"
+#include "../common/EGLDevice.h"
+#include "../common/ipc-messages.h"
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -46,17 +47,26 @@ class RendererBackendEGL final : private IPC::MessageHandler
 
     EGLNativeDisplayType getDisplay() const noexcept
     {
-        return EGL_DEFAULT_DISPLAY;
+        return EGLDevice::getNativeDisplay(m_deviceIndex);
     }
 
     EGLenum getPlatform() const noexcept
     {
-        return EGL_PLATFORM_SURFACELESS_MESA;
+        return EGLDevice::getPlatform(m_deviceIndex);
+    }
+
+    int32_t getDeviceIndex() const noexcept
+    {
+        return m_deviceIndex;
     }
 
   private:
     RendererBackendEGL(int rendererHostClientFd) noexcept;
+
+    friend IPC::RendererBackendEGLMessages;
     void handleMessage(IPC::Channel& channel, const IPC::Message& message) noexcept override;
+    void handle(const IPC::EGLDeviceSelection& message) noexcept;
 
     IPC::Channel m_ipcChannel;
+    int32_t m_deviceIndex = EGLDevice::DEFAULT_DEVICE;
 };
@@ -28,6 +28,8 @@
 
 #include "../common/ipc-messages.h"
 
+#include <limits>
+
 wpe_renderer_backend_egl_target_interface* RendererBackendEGLTarget::getWPEInterface() noexcept
 {
     static wpe_renderer_backend_egl_target_interface s_interface = {
@@ -45,7 +47,9 @@ wpe_renderer_backend_egl_target_interface* RendererBackendEGLTarget::getWPEInter
         // EGLNativeWindowType get_native_window(void* data)
         +[](void*) -> EGLNativeWindowType { return nullptr; },
         // void resize(void* data, uint32_t width, uint32_t height)
-        +[](void*, uint32_t, uint32_t) {},
+        +[](void* data, uint32_t width, uint32_t height) {
+            static_cast<RendererBackendEGLTarget*>(data)->resize(width, height);
+        },
         // void frame_will_render(void* data)
         +[](void* data) { static_cast<RendererBackendEGLTarget*>(data)->frameWillRender(); },
         // void frame_rendered(void* data)
@@ -68,6 +72,18 @@ void RendererBackendEGLTarget::init(RendererBackendEGL* backend, uint32_t width,
     m_width = width;
     m_height = height;
 
+    // Sent before the handshake, so that the ViewBackend answers with the transports supported by the same device
+    m_ipcChannel.sendMessage(IPC::EGLDeviceSelection(backend->getDeviceIndex()));
+
+    // The display is the one already initialized by WPEWebProcess, so that its extensions can be queried
+    EGLDisplay display = eglGetPlatformDisplay(backend->getPlatform(), backend->getDisplay(), nullptr);
+    uint32_t capabilities =
+        (IPC::ProtocolHandshake::SUPPORTED_CAPABILITIES &
+         ~(IPC::ProtocolHandshake::TRANSPORT_CAPABILITIES | IPC::ProtocolHandshake::DMABufReleaseFence)) |
+        FrameTransport::getSupportedProducerTransports(display);
+    if (FrameTransport::hasNativeFenceSync(display))
+        capabilities |= IPC::ProtocolHandshake::DMABufReleaseFence;
+    m_ipcChannel.sendMessage(IPC::ProtocolHandshake(IPC::ProtocolHandshake::PROTOCOL_VERSION, capabilities));
     m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::WaitingForFd));
 }
 
@@ -76,8 +92,11 @@ void RendererBackendEGLTarget::shut() noexcept
     m_backend = nullptr;
     m_width = 0;
     m_height = 0;
+    m_surfaceWidth = 0;
+    m_surfaceHeight = 0;
 
-    m_producerStream.reset();
+    m_dmaBufProducer = nullptr;
+    m_frameProducer.reset();
     m_frameRendered = false;
 
     if (m_consumerStreamFD != -1)
@@ -85,6 +104,66 @@ void RendererBackendEGLTarget::shut() noexcept
         close(m_consumerStreamFD);
         m_consumerStreamFD = -1;
     }
+
+    m_frameMetadataRing.reset();
+    closeFrameMetadataFDs();
+    m_frameId = 0;
+}
+
+void RendererBackendEGLTarget::resize(uint32_t width, uint32_t height) noexcept
+{
+    // Called from the compositor thread, like the frame rendering
+    m_width = width;
+    m_height = height;
+
+    // The surface size is computed when the frame producer is created
+    if (!m_frameProducer)
+        return;
+
+    const uint32_t surfaceWidth = m_surfaceWidth;
+    const uint32_t surfaceHeight = m_surfaceHeight;
+    updateSurfaceSize();
+    if ((m_surfaceWidth == surfaceWidth) && (m_surfaceHeight == surfaceHeight))
+        return;
+
+    if (!(m_capabilities & IPC::ProtocolHandshake::LiveResize))
+    {
+        g_warning("ViewBackend doesn't support live resize, the surface is kept at %ux%u", surfaceWidth, surfaceHeight);
+        m_surfaceWidth = surfaceWidth;
+        m_surfaceHeight = surfaceHeight;
+        return;
+    }
+
+    if (auto* producer = m_dmaBufProducer.load())
+    {
+        // The buffers are reallocated in place, the ViewBackend ignores the frames and releases of the previous ones
+        producer->resize(static_cast<EGLint>(m_surfaceWidth), static_cast<EGLint>(m_surfaceHeight));
+        return;
+    }
+
+    // EGLStreams have a fixed size, a new one is negotiated like at initialization, over the same IPC channel
+    m_frameProducer.reset();
+    m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::WaitingForFd));
+}
+
+void RendererBackendEGLTarget::updateSurfaceSize() noexcept
+{
+    m_surfaceWidth = m_width;
+    m_surfaceHeight = m_height;
+
+    // Smallest bucket containing the view, by area
+    std::unique_lock<std::mutex> lock(m_sizeBucketsMutex);
+    uint64_t bucketArea = std::numeric_limits<uint64_t>::max();
+    for (const auto& bucket : m_sizeBuckets)
+    {
+        const uint64_t area = static_cast<uint64_t>(bucket.width) * bucket.height;
+        if ((bucket.width >= m_width) && (bucket.height >= m_height) && (area < bucketArea))
+        {
+            m_surfaceWidth = bucket.width;
+            m_surfaceHeight = bucket.height;
+            bucketArea = area;
+        }
+    }
 }
 
 void RendererBackendEGLTarget::frameWillRender() noexcept
@@ -92,35 +171,90 @@ void RendererBackendEGLTarget::frameWillRender() noexcept
     // Frame drawing started in ThreadedCompositor::renderLayerTree() from WPEWebProcess
     m_frameRendered = false;
 
-    if (!m_producerStream)
+    if (!m_frameProducer)
     {
-        if (m_consumerStreamFD == -1)
+        if (!createFrameProducer())
             return;
 
-        m_producerStream = EGLProducerStream::createEGLStream(eglGetCurrentDisplay(), eglGetCurrentContext(), m_width,
-                                                              m_height, m_consumerStreamFD);
-        close(m_consumerStreamFD);
-        m_consumerStreamFD = -1;
-
-        if (!m_producerStream)
+        // The frame metadata ring, if any, is always received before the handshake answer
+        if (m_frameMetadataMemoryFD != -1)
         {
-            m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Error));
-            g_critical("Cannot create the producer EGLStream on RendererBackendEGLTarget side");
-            return;
+            m_frameMetadataRing =
+                FrameMetadataRing::createFromFileDescriptors(m_frameMetadataMemoryFD, m_frameMetadataDoorbellFD);
+            m_frameMetadataMemoryFD = -1;
+            m_frameMetadataDoorbellFD = -1;
+            if (!m_frameMetadataRing)
+                g_warning("Cannot map the frame metadata ring on RendererBackendEGLTarget side");
         }
 
         m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Connected));
     }
 
-    if (m_producerStream->makeCurrent())
+    // A dropped frame still consumes an identifier, so that the consumer reports it from the identifiers gap
+    if (m_frameProducer->makeCurrent())
         m_frameRendered = true;
+    else
+        ++m_frameId;
+}
+
+bool RendererBackendEGLTarget::createFrameProducer() noexcept
+{
+    updateSurfaceSize();
+    if (m_capabilities & IPC::ProtocolHandshake::DMABufTransport)
+    {
+        auto producer = DMABufFrameProducer::create(eglGetCurrentDisplay(), eglGetCurrentContext(), m_surfaceWidth,
+                                                    m_surfaceHeight, m_ipcChannel);
+        if (!producer)
+        {
+            m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Error));
+            g_critical("Cannot create the DMA-BUF frame producer on RendererBackendEGLTarget side");
+            return false;
+        }
+
+        m_dmaBufProducer = producer.get();
+        m_frameProducer = std::move(producer);
+        return true;
+    }
+
+    // EGLStreams are used by default, and need the consumer stream file descriptor
+    if (m_consumerStreamFD == -1)
+        return false;
+
+    m_frameProducer = EGLProducerStream::createEGLStream(eglGetCurrentDisplay(), eglGetCurrentContext(),
+                                                         m_surfaceWidth, m_surfaceHeight, m_consumerStreamFD);
+    close(m_consumerStreamFD);
+    m_consumerStreamFD = -1;
+
+    if (!m_frameProducer)
+    {
+        m_ipcChannel.sendMessage(IPC::EGLStreamState(IPC::EGLStreamState::State::Error));
+        g_critical("Cannot create the producer EGLStream on RendererBackendEGLTarget side");
+        return false;
+    }
+
+    return true;
 }
 
 void RendererBackendEGLTarget::frameRendered() noexcept
 {
     // Frame drawing finished in ThreadedCompositor::renderLayerTree() from WPEWebProcess
     if (m_frameRendered)
-        m_producerStream->swapBuffers();
+    {
+        // Metadata are pushed before the frame is presented, so that they are available when the frame is acquired
+        ++m_frameId;
+        if (m_frameMetadataRing)
+            m_frameMetadataRing->push({m_frameId, g_get_monotonic_time()});
+
+        m_frameProducer->swapBuffers(m_frameId);
+
+        // DMA-BUF frames are already announced by the transport itself
+        if ((m_capabilities & IPC::ProtocolHandshake::EGLStreamFrameNotification) &&
+            !(m_capabilities & IPC::ProtocolHandshake::DMABufTransport))
+        {
+            // Only the latest frame identifier matters to the consumer, so a lagging one only gets that one
+            m_ipcChannel.sendMessage(IPC::EGLStreamFrame(m_frameId), IPC::Channel::Delivery::Coalesced);
+        }
+    }
 
     wpe_renderer_backend_egl_target_dispatch_frame_complete(m_wpeTarget);
 }
@@ -128,13 +262,68 @@ void RendererBackendEGLTarget::frameRendered() noexcept
 void RendererBackendEGLTarget::handleMessage(IPC::Channel& /*channel*/, const IPC::Message& message) noexcept
 {
     // Messages received on WPEWebProcess side from ViewBackend on application process side
-    switch (message.getCode())
+    if (!IPC::RendererBackendEGLTargetMessages::dispatch(*this, message))
+        g_debug("Unknown IPC message %u received on RendererBackendEGLTarget side", message.getCode());
+}
+
+void RendererBackendEGLTarget::handle(const IPC::ProtocolHandshake& message) noexcept
+{
+    // Capabilities accepted by both sides, including the selected frame transport
+    m_protocolVersion = message.getVersion();
+    m_capabilities = message.getCapabilities() & IPC::ProtocolHandshake::SUPPORTED_CAPABILITIES;
+}
+
+void RendererBackendEGLTarget::handle(const IPC::EGLStreamFileDescriptor& message) noexcept
+{
+    m_consumerStreamFD = message.getFD();
+}
+
+void RendererBackendEGLTarget::handle(const IPC::FrameMetadataRingFileDescriptors& message) noexcept
+{
+    closeFrameMetadataFDs();
+    m_frameMetadataMemoryFD = message.getMemoryFD();
+    m_frameMetadataDoorbellFD = message.getDoorbellFD();
+}
+
+void RendererBackendEGLTarget::handle(const IPC::DMABufRelease& message) noexcept
+{
+    if (auto* producer = m_dmaBufProducer.load())
+        producer->releaseBuffer(message.getIndex(), message.getGeneration());
+}
+
+void RendererBackendEGLTarget::handle(const IPC::DMABufReleaseFence& message) noexcept
+{
+    if (auto* producer = m_dmaBufProducer.load())
+        producer->releaseBuffer(message.getIndex(), message.getGeneration(), message.getFD());
+    else
+        close(message.getFD());
+}
+
+void RendererBackendEGLTarget::handle(const IPC::SurfaceSizeBuckets& message) noexcept
+{
+    // Received before the handshake answer, so before the frame producer creation
+    std::unique_lock<std::mutex> lock(m_sizeBucketsMutex);
+    m_sizeBuckets.clear();
+    for (uint16_t i = 0; i < message.getCount(); ++i)
+        m_sizeBuckets.push_back(message.getSize(i));
+}
+
+void RendererBackendEGLTarget::closeFrameMetadataFDs() noexcept
+{
+    if (m_frameMetadataMemoryFD != -1)
     {
-    case IPC::EGLStreamFileDescriptor::MESSAGE_CODE:
-        m_consumerStreamFD = static_cast<const IPC::EGLStreamFileDescriptor&>(message).getFD();
-        break;
+        close(m_frameMetadataMemoryFD);
+        m_frameMetadataMemoryFD = -1;
+    }
 
-    default:
-        break;
+    if (m_frameMetadataDoorbellFD != -1)
+    {
+        close(m_frameMetadataDoorbellFD);
+        m_frameMetadataDoorbellFD = -1;
     }
 }
+
+void RendererBackendEGLTarget::handleSendQueueHighWater(IPC::Channel& /*channel*/, size_t depth) noexcept
+{
+    g_warning("ViewBackend is lagging behind, %zu IPC messages are waiting to be sent", depth);
+}
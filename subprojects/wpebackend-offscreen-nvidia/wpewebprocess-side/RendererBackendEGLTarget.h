@@ -26,9 +26,16 @@
 
 #pragma once
 
+#include "../common/DMABufTransport.h"
 #include "../common/EGLStream.h"
+#include "../common/FrameMetadataRing.h"
+#include "../common/ipc-messages.h"
 #include "RendererBackendEGL.h"
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 class RendererBackendEGLTarget final : private IPC::MessageHandler
 {
   public:
@@ -47,25 +54,58 @@ class RendererBackendEGLTarget final : private IPC::MessageHandler
     void init(RendererBackendEGL* backend, uint32_t width, uint32_t height) noexcept;
     void shut() noexcept;
 
+    void resize(uint32_t width, uint32_t height) noexcept;
     void frameWillRender() noexcept;
     void frameRendered() noexcept;
 
   private:
+    // Messages are sent from the compositor thread, which must never be blocked by a lagging ViewBackend
+    static constexpr size_t IPC_SEND_QUEUE_MAX_SIZE = 64;
+    static constexpr size_t IPC_SEND_QUEUE_HIGH_WATER_MARK = 16;
+
     wpe_renderer_backend_egl_target* m_wpeTarget = nullptr;
     IPC::Channel m_ipcChannel;
 
     RendererBackendEGLTarget(wpe_renderer_backend_egl_target* wpeTarget, int viewBackendFd) noexcept
         : m_wpeTarget(wpeTarget), m_ipcChannel(*this, viewBackendFd)
     {
+        m_ipcChannel.setNonBlockingSend(IPC_SEND_QUEUE_MAX_SIZE, IPC_SEND_QUEUE_HIGH_WATER_MARK);
     }
 
+    friend IPC::RendererBackendEGLTargetMessages;
+    uint16_t m_protocolVersion = 0;
+    // Read from the compositor thread to select the frame transport
+    std::atomic<uint32_t> m_capabilities = 0;
     void handleMessage(IPC::Channel& channel, const IPC::Message& message) noexcept override;
+    void handle(const IPC::ProtocolHandshake& message) noexcept;
+    void handle(const IPC::EGLStreamFileDescriptor& message) noexcept;
+    void handle(const IPC::FrameMetadataRingFileDescriptors& message) noexcept;
+    void handle(const IPC::DMABufRelease& message) noexcept;
+    void handle(const IPC::SurfaceSizeBuckets& message) noexcept;
+    void handle(const IPC::DMABufReleaseFence& message) noexcept;
+    void handleSendQueueHighWater(IPC::Channel& channel, size_t depth) noexcept override;
 
     RendererBackendEGL* m_backend = nullptr;
     uint32_t m_width = 0;
     uint32_t m_height = 0;
 
+    // The producer surface may be larger than the view, when it fits into one of the size buckets
+    uint32_t m_surfaceWidth = 0;
+    uint32_t m_surfaceHeight = 0;
+    std::mutex m_sizeBucketsMutex;
+    std::vector<IPC::SurfaceSizeBuckets::Size> m_sizeBuckets;
+    void updateSurfaceSize() noexcept;
+
     int m_consumerStreamFD = -1;
-    std::unique_ptr<EGLProducerStream> m_producerStream;
+    std::unique_ptr<FrameProducer> m_frameProducer;
+    // Buffers release notifications are dispatched from the WPEWebProcess main thread
+    std::atomic<DMABufFrameProducer*> m_dmaBufProducer = nullptr;
     bool m_frameRendered = false;
+    bool createFrameProducer() noexcept;
+
+    int m_frameMetadataMemoryFD = -1;
+    int m_frameMetadataDoorbellFD = -1;
+    std::unique_ptr<FrameMetadataRing> m_frameMetadataRing;
+    uint64_t m_frameId = 0;
+    void closeFrameMetadataFDs() noexcept;
 };